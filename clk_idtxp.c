@@ -9,21 +9,82 @@
  * A PARTICULAR PURPOSE, or NON-INFRINGEMENT.
  */
 
+#include <linux/bitmap.h>
 #include <linux/clk.h>
 #include <linux/clk-provider.h>
+#include <linux/completion.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/i2c.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/pm_runtime.h>
 #include <linux/regmap.h>
+#include <linux/rwsem.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/debugfs.h>
 
+#include "clk_idtxp_core.h"
+#include "clk_idtxp_ioctl.h"
+
+#define CREATE_TRACE_POINTS
+#include "clk_idtxp_trace.h"
+
 #define NUM_CONFIG_REGISTERS		256
 #define NUM_FREQ_REGISTERS		6
 #define NUM_MISCELLANEOUS_REGISTERS	8
+#define IDTXP_RATE_CACHE_SIZE		8
+#define IDTXP_HIST_BUCKETS		32
+
+/* PLL lock wait after a large frequency change */
+#define IDTXP_LOCK_EST_NS		200000
+#define IDTXP_LOCK_POLL_MIN_US		10
+#define IDTXP_LOCK_TIMEOUT_US		20000
+#define IDTXP_GLIDE_STEP_US		1000
+#define IDTXP_NVM_PROG_MS		20
+#define IDTXP_AUTOSUSPEND_MS		1000
+#define IDTXP_SCRIPT_MAX_WRITES		256
+#define IDTXP_SCRIPT_MAX_SIZE		4096
+#define IDTXP_SCRIPT_BIN_TRIGGER	0x01
+
+/* Fine trim, kept so that a step stays under the small change threshold */
+#define IDTXP_TRIM_MAX_PPB		200000
 
 #define DEBUGFS_ROOT_DIR_NAME		"idtxp_pro_xo"
 #define DEBUGFS_I2C_FILE_NAME		"i2c"
+#define DEBUGFS_I2C_BIN_FILE_NAME	"i2c_bin"
+#define DEBUGFS_CACHE_HITS_FILE_NAME	"rate_cache_hits"
+#define DEBUGFS_CACHE_MISSES_FILE_NAME	"rate_cache_misses"
+#define DEBUGFS_RATE_FILE_NAME		"rate"
+#define DEBUGFS_LATENCY_FILE_NAME	"latency"
+#define DEBUGFS_LATENCY_RESET_FILE_NAME	"latency_reset"
+#define DEBUGFS_RATE_WAIT_FILE_NAME	"rate_wait"
+#define DEBUGFS_RATE_REQUESTS_FILE_NAME	"rate_requests"
+#define DEBUGFS_RATE_COALESCED_FILE_NAME	"rate_coalesced"
+#define DEBUGFS_GLIDE_FILE_NAME		"glide"
+#define DEBUGFS_PRESET_FILE_NAME	"preset"
+#define DEBUGFS_PRESTAGE_FILE_NAME	"prestage"
+#define DEBUGFS_NVM_COMMIT_FILE_NAME	"nvm_commit"
+#define DEBUGFS_NVM_WRITES_FILE_NAME	"nvm_writes"
+#define DEBUGFS_REGS_FILE_NAME		"regs"
+#define DEBUGFS_DIVO_FILE_NAME		"divo"
+#define DEBUGFS_DIVNINT_FILE_NAME	"divnint"
+#define DEBUGFS_DIVNFRAC_FILE_NAME	"divnfrac"
+#define DEBUGFS_FVCO_FILE_NAME		"fvco"
+#define DEBUGFS_ICP_VALUE_FILE_NAME	"icp_value"
+#define DEBUGFS_XO_DIR_NAME		"xo"
 
 /* Frequency0 */
 #define IDTXP_REG_DIVO_7_0			0x10
@@ -38,7 +99,7 @@
 #define IDTXP_REG_DBLR_DIS_VDD			0x51
 #define IDTXP_REG_VCXO				0x52
 #define IDTXP_REG_OE_POL_DRV_TYPE		0x53
-//#define IDTXP_REG_I2C_ADDR			0x54
+#define IDTXP_REG_I2C_ADDR			0x54
 #define IDTXP_REG_XO_0				0x55
 #define IDTXP_REG_XO_1				0x56
 #define IDTXP_REG_XO_2				0x57
@@ -77,59 +138,93 @@
 #define IDTXP_SMALL_FREQ_CHG_MASK		0x02
 #define IDTXP_LARGE_FREQ_CHG_MASK		0x01
 
-/* Limits */
-#define DIVO_MIN    		4
-#define DIVO_MAX    		511
-
-#define DIVN_MIN    		41
-#define DIVN_MAX   		216
-
-#define FVCO_MIN    		6860000000LL
-#define FVCO_MAX    		8650000000LL
-
-#define IDTXP_MIN_FREQ          16000000LL
-#define IDTXP_MAX_FREQ          2100000000LL
-#define IDTXP_HCSL_MAX_FREQ     725000000LL
-
-/**
- * @hsp_i2c_en:		high speed i2c enable
- * @cmos_en:		cmos output enable
- * @dblr_dis:		XO frequency doubler disable
- * @vdd_def:		power supply voltage
- * @vcxo_dis:		vcxo disabler
- * @vcxo_bw:		vcxo modulation bandwidth
- * @vcxo_gslope:	vcxo gain slope
- * @vcxo_gexp:		vcxo gain expoentially
- * @vcxo_gscale:	vcxo gain scale
- * @oe_pol_en:		output enable polarity
- * @drv_type:		output logic type
- * @gm:			XO amplifier gm overtone
- * @cap_x1:		XO load capacitance trim value, x1 pin
- * @ampslice:		XO amplifier slice
- * @bypass:		bypass the XO oscillator
- * @cap_x2:		XO load capacitance trim value, x2 pin
- * @ot_dis:		overtone operation disable
- * @ot_res:		overtone filter resistor value
- */
-struct clk_xo_setting {
-	bool hsp_i2c_en;
-	bool cmos_en;
+/**
+ * struct idtxp_rate_cache_entry - Previously solved settings for a rate.
+ * @req_freq:		requested output frequency (in Hz), 0 if unused
+ * @fxtal:		factory xtal frequency the entry was solved with
+ * @dblr_dis:		XO doubler setting the entry was solved with
+ * @last_use:		rate_cache_tick at the last hit, for LRU replacement
+ * @divs:		the solved dividers
+ * @icp_value:		charge pump value
+ * @regs:		encoded values of registers 0x10-0x15
+ */
+struct idtxp_rate_cache_entry {
+	u32 req_freq;
+	u32 fxtal;
 	bool dblr_dis;
-	u8 vdd_def;
-	bool vcxo_dis;
-	u8 vcxo_bw;
-	bool vcxo_gslope;
-	u8 vcxo_gexp;
-	u8 vcxo_gscale;
-	bool oe_pol_en;
-	u8 drv_type;
-	u8 gm;
-	u8 cap_x1;
-	u8 ampslice;
-	bool bypass;
-	u8 cap_x2;
-	bool ot_dis;
-	u8 ot_res;
+	u32 last_use;
+	struct idtxp_divs divs;
+	u8 icp_value;
+	u8 regs[NUM_FREQ_REGISTERS];
+};
+
+/**
+ * struct idtxp_preset - Settings solved at probe for a DT preset rate.
+ * @rate:		output frequency listed in DT (in Hz)
+ * @act_rate:		output frequency the dividers generate (in Hz), 0 if
+ *			the rate does not solve, the preset is then unused
+ * @divs:		the solved dividers
+ * @icp_value:		charge pump value
+ * @regs:		encoded values of registers 0x10-0x15
+ */
+struct idtxp_preset {
+	u32 rate;
+	u32 act_rate;
+	struct idtxp_divs divs;
+	u8 icp_value;
+	u8 regs[NUM_FREQ_REGISTERS];
+};
+
+/* Phases of idtxp_set_rate() timed into the latency histograms */
+enum idtxp_phase {
+	IDTXP_PHASE_LOCK,
+	IDTXP_PHASE_SOLVE,
+	IDTXP_PHASE_WRITE,
+	IDTXP_PHASE_SETUP,
+	IDTXP_PHASE_TRIGGER,
+	IDTXP_PHASE_PLL_LOCK,
+	IDTXP_PHASE_TOTAL,
+	IDTXP_NUM_PHASES
+};
+
+static const char * const idtxp_phase_names[IDTXP_NUM_PHASES] = {
+	[IDTXP_PHASE_LOCK]	= "lock",
+	[IDTXP_PHASE_SOLVE]	= "solve",
+	[IDTXP_PHASE_WRITE]	= "write",
+	[IDTXP_PHASE_SETUP]	= "setup",
+	[IDTXP_PHASE_TRIGGER]	= "trigger",
+	[IDTXP_PHASE_PLL_LOCK]	= "pll_lock",
+	[IDTXP_PHASE_TOTAL]	= "total",
+};
+
+enum idtxp_path {
+	IDTXP_PATH_LARGE,
+	IDTXP_PATH_SMALL,
+	IDTXP_PATH_GLIDE,
+	IDTXP_PATH_TRIM,
+	IDTXP_NUM_PATHS
+};
+
+static const char * const idtxp_path_names[IDTXP_NUM_PATHS] = {
+	[IDTXP_PATH_LARGE]	= "large",
+	[IDTXP_PATH_SMALL]	= "small",
+	[IDTXP_PATH_GLIDE]	= "glide",
+	[IDTXP_PATH_TRIM]	= "trim",
+};
+
+/**
+ * struct idtxp_hist - Log-scale latency histogram.
+ * @count:		number of samples
+ * @sum_ns:		sum of all samples (in ns)
+ * @max_ns:		largest sample (in ns)
+ * @buckets:		bucket i counts samples in [2^i, 2^(i+1)) ns, the
+ *			first also takes 0 and the last everything above
+ */
+struct idtxp_hist {
+	u64 count;
+	u64 sum_ns;
+	u64 max_ns;
+	u64 buckets[IDTXP_HIST_BUCKETS];
 };
 
 /**
@@ -137,17 +232,31 @@ struct clk_xo_setting {
  * @hw:			clock hw struct
  * @regmap:		register map used to perform i2c writes to the chip
  * @i2c_client:		I2C client pointer
+ * @lock:		serialises the register image and device accesses
+ * @regs:		register image, what the device holds once committed
+ * @regs_valid:		registers whose device value is known to match regs
+ * @regs_dirty:		registers staged in regs but not yet written
+ * @nvm_regs:		NVM contents, as read back at probe or last committed
+ * @nvm_valid:		registers whose NVM value is known
+ * @nvm_writes:		number of commits to NVM
  * @has_settings:	true if settings array is valid
  * @settings:		full register map from device tree
  * @min_freq:		mininum frequency for this device
  * @max_freq:		maximum frequency for this device
  * @xo:			struct for the miscellaneous settings and XO mode
  * @fxtal:		factory xtal frequency
+ * @solver:		divider solver state, the phase detector frequency and
+ *			the integer mode policy
+ * @fvco:		VCO frequency (in Hz)
  * @divo:		output clock divider
  * @divnint:		int component of feedback divider for VCO
  * @divnfrac:		fractional component of feedback divider for VCO
  * @req_freq:		request output frequency (in Hz)
  * @act_freq:		actual output clock frequency (in Hz)
+ * @rate_num:		numerator of the exact output frequency (in Hz)
+ * @rate_den:		denominator of the exact output frequency
+ * @scaled_ppm:		error of the dividers against req_freq, in ppm
+ *			with a 16-bit binary fractional field
  * @icp_offset_en:	charge pump offset enable
  * @icp_value:		charge pump value
  * @pll_mode:		pll mode
@@ -155,13 +264,85 @@ struct clk_xo_setting {
  * @divnint_8_7:	stores the value for setting register
  * @divnfrac_15_8:	stores the value for setting register
  * @divnfrac_23_18:	stores the value for setting register
- * @debugfs_root_dir:	the directory of debugfs
+ * @div_regs:		encoded values of registers 0x10-0x15
+ * @rate_cache:		LRU cache of settings solved by idtxp_solve_rate()
+ * @rate_cache_tick:	use counter for rate_cache
+ * @rate_cache_hits:	number of rates served from rate_cache
+ * @rate_cache_misses:	number of rates that had to be solved
+ * @presets:		rates from the frequency-presets DT property
+ * @num_presets:	number of entries in presets
+ * @prestage:		settings solved ahead of time for the next rate hinted
+ * @prestage_valid:	prestage holds a rate
+ * @prestage_hits:	number of rate changes served from prestage
+ * @hist:		set_rate latency per path and phase
+ * @pll_locked:		completed once the last frequency change is done
+ *			settling, see pll_lock_err
+ * @pll_lock_err:	result of the last PLL lock wait, so a lock timeout
+ *			is recorded rather than left pending
+ * @lock_est_ns:	running estimate of the PLL lock time (in ns)
+ * @relock_seq:		counts the re-arms of pll_locked, so a lock wait done
+ *			without the lock can tell it was overtaken
+ * @lock_readback:	LOCK_PLL of CONTROL is known to read back the PLL lock
+ *			state, from the pll-lock-readback DT property
+ * @async_rate:		set_rate only queues the rate for rate_work
+ * @rate_work:		programs pending_rate in async_rate mode
+ * @pending_lock:	protects the pending_rate to rate_done fields
+ * @pending_rate:	newest rate queued and not yet taken by rate_work,
+ *			0 if none
+ * @rate_requests:	number of rates queued
+ * @rate_coalesced:	number of queued rates replaced before programming
+ * @rate_err:		result of programming the last queued rate
+ * @rate_done:		completed once no queued rate is left to program
+ * @hint_rate:		rate the next set_rate is expected at, 0 if none, see
+ *			idtxp_set_rate_policy()
+ * @hint_policy:	policy to program hint_rate with
+ * @hint_err:		result of programming hint_rate
+ * @glide_timer:	fires when the next glide step is due
+ * @glide_work:		writes one glide step
+ * @glide_active:	a glide is in progress
+ * @glide_divo:		output divider held for the whole glide
+ * @glide_target:	rate the glide ends at (in Hz)
+ * @glide_rate:		rate of the last glide step (in Hz)
+ * @glide_step_hz:	largest change of one glide step (in Hz)
+ * @glide_interval_ns:	time between two glide steps
+ * @glide_next:		expiry of glide_timer
+ * @glide_start_ns:	ktime_get_ns() when the glide was started
+ * @glide_start_rate:	act_freq when the glide was started (in Hz)
+ * @glide_steps:	number of glide steps written
+ * @glide_slew:		achieved slew of the glide (in Hz/s)
+ * @glide_err:		result of the last glide
+ * @glide_done:		completed once no glide is in progress
+ * @trim_valid:		trim_base holds the feedback divider trimmed from
+ * @trim_base:		feedback divider at no trim, as idtxp_divn_total()
+ * @trim_scaled_ppm:	last trim applied, in ppm with a 16-bit binary
+ *			fractional field
+ * @trims:		number of trims applied
+ * @ptp_info:		PTP clock ops, only adjfine is supported
+ * @ptp:		the PTP clock, NULL if not registered
+ * @suspended:		the device may be unpowered, register writes are only
+ *			staged until it resumes
+ * @misc:		the character device of this device
+ * @cdev:		what the open files of misc share, outlives the device
+ * @policy_lock:	serializes idtxp_set_rate_policy() over the hint fields
+ * @readers_lock:	protects readers and their event queues
+ * @readers:		open files of misc, to queue the events to
+ * @debugfs_work:	creates the debugfs directory once probe is done
+ * @debugfs_root_dir:	the debugfs directory of this device
  * @debugfs_i2c_file:	read and write the registers through the i2c
  */
 struct clk_idtxp {
 	struct clk_hw hw;
 	struct regmap *regmap;
 	struct i2c_client *i2c_client;
+	struct mutex lock;
+
+	u8 regs[NUM_CONFIG_REGISTERS];
+	DECLARE_BITMAP(regs_valid, NUM_CONFIG_REGISTERS);
+	DECLARE_BITMAP(regs_dirty, NUM_CONFIG_REGISTERS);
+
+	u8 nvm_regs[NUM_CONFIG_REGISTERS];
+	DECLARE_BITMAP(nvm_valid, NUM_CONFIG_REGISTERS);
+	u64 nvm_writes;
 
 	bool has_settings;
 	u8 settings[NUM_CONFIG_REGISTERS];
@@ -172,65 +353,287 @@ struct clk_idtxp {
 	struct clk_xo_setting xo;
 
 	u32 fxtal;
+	struct idtxp_solver solver;
 	u64 fvco;
 	u16 divo;
 	u16 divnint;
 	u32 divnfrac;
 	u32 req_freq;
 	u32 act_freq;
+	u64 rate_num;
+	u64 rate_den;
+	s64 scaled_ppm;
 	bool icp_offst_en;
 	u8 icp_value;
 	bool pll_mode;
+
 	
 	u8 divo_8;
 	u8 divnint_8_7;
 	u8 divnfrac_15_8;
 	u8 divnfrac_23_16;
-
+	u8 div_regs[NUM_FREQ_REGISTERS];
+
+	struct idtxp_rate_cache_entry rate_cache[IDTXP_RATE_CACHE_SIZE];
+	u32 rate_cache_tick;
+	u64 rate_cache_hits;
+	u64 rate_cache_misses;
+
+	struct idtxp_preset *presets;
+	unsigned int num_presets;
+	struct idtxp_preset prestage;
+	bool prestage_valid;
+	u64 prestage_hits;
+
+	struct idtxp_hist hist[IDTXP_NUM_PATHS][IDTXP_NUM_PHASES];
+
+	struct completion pll_locked;
+	int pll_lock_err;
+	u64 lock_est_ns;
+	unsigned long relock_seq;
+	bool lock_readback;
+
+	bool async_rate;
+	struct work_struct rate_work;
+	spinlock_t pending_lock;
+	unsigned long pending_rate;
+	u64 rate_requests;
+	u64 rate_coalesced;
+	int rate_err;
+	struct completion rate_done;
+
+	unsigned long hint_rate;
+	enum idtxp_rate_policy hint_policy;
+	int hint_err;
+
+	struct hrtimer glide_timer;
+	struct work_struct glide_work;
+	bool glide_active;
+	u16 glide_divo;
+	u32 glide_target;
+	u32 glide_rate;
+	u32 glide_step_hz;
+	u64 glide_interval_ns;
+	ktime_t glide_next;
+	u64 glide_start_ns;
+	u32 glide_start_rate;
+	u64 glide_steps;
+	u64 glide_slew;
+	int glide_err;
+	struct completion glide_done;
+
+	bool trim_valid;
+	u64 trim_base;
+	long trim_scaled_ppm;
+	u64 trims;
+	struct ptp_clock_info ptp_info;
+	struct ptp_clock *ptp;
+
+	bool suspended;
+
+	struct miscdevice misc;
+	struct idtxp_cdev *cdev;
+	struct mutex policy_lock;
+	spinlock_t readers_lock;
+	struct list_head readers;
+
+	struct work_struct debugfs_work;
 	struct dentry *debugfs_root_dir, *debugfs_i2c_file;
 };
 #define to_clk_idtxp(_hw)	container_of(_hw, struct clk_idtxp, hw)
 
+/**
+ * struct idtxp_cdev - What the open files of a device share.
+ * @kref:		held by the device until it is removed, and by each
+ *			open file
+ * @rwsem:		held for reading while an open file uses data, for
+ *			writing while data is detached
+ * @data:		the device, NULL once it is removed, see
+ *			idtxp_cdev_detach()
+ */
+struct idtxp_cdev {
+	struct kref kref;
+	struct rw_semaphore rwsem;
+	struct clk_idtxp *data;
+};
+
+/**
+ * struct idtxp_reader - An open file of the character device.
+ * @cdev:		shared with the device and its other open files
+ * @node:		entry in the readers of the device
+ * @wait:		woken up when an event is queued or the device is removed
+ * @events:		ring of events not read yet
+ * @head:		index of the oldest event in events
+ * @count:		number of events in events
+ */
+struct idtxp_reader {
+	struct idtxp_cdev *cdev;
+	struct list_head node;
+	wait_queue_head_t wait;
+	struct idtxp_event events[IDTXP_EVENT_QUEUE_LEN];
+	unsigned int head;
+	unsigned int count;
+};
+
+/* Holds one directory per device, named after it */
+static struct dentry *idtxp_debugfs_root;
+
 enum clk_idtxp_variant {
 	idtxp_xo
 };
 
+static const struct regmap_range idtxp_volatile_ranges[] = {
+	/* LOCK_PLL reads back the PLL lock state */
+	regmap_reg_range(IDTXP_REG_CONTROL, IDTXP_REG_CONTROL),
+	/* a command, never to be replayed from the cache */
+	regmap_reg_range(IDTXP_REG_FREQ_CHG, IDTXP_REG_FREQ_CHG),
+};
+
+static const struct regmap_access_table idtxp_volatile_table = {
+	.yes_ranges = idtxp_volatile_ranges,
+	.n_yes_ranges = ARRAY_SIZE(idtxp_volatile_ranges),
+};
+
+static const struct regmap_range idtxp_read_only_ranges[] = {
+	/* the device would leave its bus address */
+	regmap_reg_range(IDTXP_REG_I2C_ADDR, IDTXP_REG_I2C_ADDR),
+};
+
+static const struct regmap_access_table idtxp_writeable_table = {
+	.no_ranges = idtxp_read_only_ranges,
+	.n_no_ranges = ARRAY_SIZE(idtxp_read_only_ranges),
+};
+
 /**
- * bit_to_shift() - Number of bits to shift given specified mask.
- * @mask:	32-bit word input to count zero bits on right.
- * 
- * Return: Number of bits to shift.
+ * idtxp_read_regs() - Read a register range into the register image.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @reg:	First register.
+ * @count:	Number of registers.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_read_regs(struct clk_idtxp *data, unsigned int reg,
+			   unsigned int count)
+{
+	int err;
+
+	err = regmap_bulk_read(data->regmap, reg, &data->regs[reg], count);
+	if (err)
+		return err;
+
+	bitmap_set(data->regs_valid, reg, count);
+	bitmap_clear(data->regs_dirty, reg, count);
+	return 0;
+}
+
+/**
+ * idtxp_read_image() - Read every register but the volatile ones.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Served from the regmap cache, where idtxp_read_regs() of the whole space
+ * would go to the bus for the volatile command registers.
+ *
+ * Return: 0 on success, negative errno otherwise.
  */
-static int bit_to_shift(unsigned int mask)
+static int idtxp_read_image(struct clk_idtxp *data)
 {
-	unsigned int c = 32;
+	unsigned int start, end;
+	int err;
+
+	for (start = 0; start < NUM_CONFIG_REGISTERS; start = end + 1) {
+		for (end = start; end < NUM_CONFIG_REGISTERS; end++)
+			if (regmap_check_range_table(data->regmap, end,
+						     &idtxp_volatile_table))
+				break;
+		if (end == start)
+			continue;
+		err = idtxp_read_regs(data, start, end - start);
+		if (err)
+			return err;
+	}
 
-	mask &= ~mask + 1;
-	if (mask)
-		c--;
-	if (mask & 0x0000FFFF)
-		c -= 16;
-	if (mask & 0x00FF00FF)
-		c -= 8;
-	if (mask & 0x0F0F0F0F)
-		c -= 4;
-	if (mask & 0x33333333)
-		c -= 2;
-	if (mask & 0x55555555)
-		c -= 1;
-	return c;
+	return 0;
 }
 
-static void set_to_reg(u8 *reg, u8 val, unsigned int mask)
+/**
+ * idtxp_stage_regs() - Update the register image without touching the bus.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @reg:	First register.
+ * @val:	New register values.
+ * @count:	Number of registers.
+ *
+ * Registers are marked dirty only if the new value differs from the image
+ * or the device value is not known. Read only registers and the volatile
+ * command registers are not state and are left alone.
+ */
+static void idtxp_stage_regs(struct clk_idtxp *data, unsigned int reg,
+			     const u8 *val, unsigned int count)
 {
-	*reg = ((*reg) & ~mask ) | (val << bit_to_shift(mask));
+	unsigned int i;
+
+	for (i = 0; i < count; i++, reg++) {
+		if (data->regs[reg] == val[i] &&
+		    test_bit(reg, data->regs_valid))
+			continue;
+		if (!regmap_check_range_table(data->regmap, reg,
+					      &idtxp_writeable_table) ||
+		    regmap_check_range_table(data->regmap, reg,
+					     &idtxp_volatile_table))
+			continue;
+		data->regs[reg] = val[i];
+		__set_bit(reg, data->regs_dirty);
+	}
 }
 
-static void get_from_reg(u8 reg, u8 *val, unsigned int mask)
+static void idtxp_stage_reg(struct clk_idtxp *data, unsigned int reg, u8 val)
 {
-	*val = (reg & mask) >> bit_to_shift(mask);
+	idtxp_stage_regs(data, reg, &val, 1);
 }
 
+/**
+ * idtxp_commit_regs() - Write the dirty registers of the image.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Each run of consecutive dirty registers goes out as one auto-increment
+ * block write. The trigger registers are commands, not state, and are
+ * written directly with idtxp_trigger() instead. While suspended the
+ * registers stay dirty, for idtxp_restore() to write them on resume.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_commit_regs(struct clk_idtxp *data)
+{
+	unsigned int start, end;
+	int err;
+
+	if (data->suspended)
+		return 0;
+
+	start = find_first_bit(data->regs_dirty, NUM_CONFIG_REGISTERS);
+	while (start < NUM_CONFIG_REGISTERS) {
+		end = find_next_zero_bit(data->regs_dirty,
+					 NUM_CONFIG_REGISTERS, start);
+		trace_idtxp_commit(&data->i2c_client->dev, start,
+				   &data->regs[start], end - start);
+		err = regmap_bulk_write(data->regmap, start,
+					&data->regs[start], end - start);
+		if (err) {
+			bitmap_clear(data->regs_valid, start, end - start);
+			return err;
+		}
+		bitmap_clear(data->regs_dirty, start, end - start);
+		bitmap_set(data->regs_valid, start, end - start);
+
+		start = find_next_bit(data->regs_dirty,
+				      NUM_CONFIG_REGISTERS, end);
+	}
+
+	return 0;
+}
 
 /**
  * update_divis_regs() - Update the value for registers.
@@ -241,29 +644,21 @@ static void get_from_reg(u8 reg, u8 *val, unsigned int mask)
 static void update_divis_regs(struct clk_idtxp* data)
 {
 	data->divo_8 = ((data->divo & (0x1 << 8)) >> 8);
-	data->divnint_8_7 = ((data->divo & (0x2 << 7)) >> 7);
+	data->divnint_8_7 = ((data->divnint & (0x3 << 7)) >> 7);
 	data->divnfrac_15_8 = ((data->divnfrac & (0xFF << 8)) >> 8);
 	data->divnfrac_23_16 = ((data->divnfrac & (0xFF << 16)) >> 16);
 }
 
 /**
- * idtxp_get_xo_settings() - Read in miscellaneous settings from registers.
+ * idtxp_decode_xo_settings() - Decode XO settings from the register image.
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
- * 
- * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_get_xo_settings(struct clk_idtxp *data)
+static void idtxp_decode_xo_settings(struct clk_idtxp *data)
 {
-	int err;
-	u8 reg[8];
+	u8 *reg = &data->regs[IDTXP_REG_HSPI2C_CMOS];
 	struct i2c_client *client = data->i2c_client;
 
-	err = regmap_bulk_read(data->regmap, IDTXP_REG_HSPI2C_CMOS,
-			reg, ARRAY_SIZE(reg));
-	if (err)
-		return err;
-
 	get_from_reg(reg[0], (u8*)&data->xo.hsp_i2c_en, IDTXP_HSPI2C_EN);
 	get_from_reg(reg[0], (u8*)&data->xo.cmos_en, IDTXP_CMOS_EN);
 	get_from_reg(reg[1], (u8*)&data->xo.dblr_dis, IDTXP_DBLR_DIS_MASK);
@@ -282,58 +677,49 @@ static int idtxp_get_xo_settings(struct clk_idtxp *data)
 	get_from_reg(reg[7], (u8*)&data->xo.ot_dis, IDTXP_OT_DIS_MASK);
 	get_from_reg(reg[7], &data->xo.ot_res, IDTXP_OT_RES_MASK);
 
-	dev_info(&client->dev,
-		 "idtxp_get_xo_settings: [dblr_dis] %d\n", 
-		 data->xo.dblr_dis);
-	dev_info(&client->dev,
-		 "idtxp_get_xo_settings: [0x50-0x57] %02x %02x %02x %02x \
+	dev_dbg(&client->dev,
+		"idtxp_get_xo_settings: [dblr_dis] %d\n",
+		data->xo.dblr_dis);
+	dev_dbg(&client->dev,
+		"idtxp_get_xo_settings: [0x50-0x57] %02x %02x %02x %02x \
 		 %02x %02x %02x %02x\n",
 		 reg[0], reg[1], reg[2], reg[3],
 		 reg[4], reg[5], reg[6], reg[7]);
-
-	return 0;
 }
 
 /**
- * idtxp_get_divs_and_icp() - Read in dividers value from registers.
+ * idtxp_decode_divs() - Decode dividers value from the register image.
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
- * 
- * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_get_divs_and_icp(struct clk_idtxp *data)
+static void idtxp_decode_divs(struct clk_idtxp *data)
 {
-	int err;
-	u8 reg[NUM_FREQ_REGISTERS];
+	u8 *reg = &data->regs[IDTXP_REG_DIVO_7_0];
+	u8 divnint_6_0;
 	struct i2c_client *client = data->i2c_client;
 
-	err = regmap_bulk_read(data->regmap, IDTXP_REG_DIVO_7_0,
-			reg, ARRAY_SIZE(reg));
-	if (err)
-		return err;
-
-	get_from_reg(reg[0], (u8*)&data->divo, 0xFF);
+	data->divo = reg[0];
 	get_from_reg(reg[1], &data->divo_8, IDTXP_DIVO_8_MASK);
-	get_from_reg(reg[1], (u8*)&data->divnint, IDTXP_DIVN_INT_6_0_MASK);
+	get_from_reg(reg[1], &divnint_6_0, IDTXP_DIVN_INT_6_0_MASK);
 	get_from_reg(reg[2],
 		     (u8*)&data->icp_offst_en,
 		     IDTXP_ICP_OFFSET_EN_MASK);
 	get_from_reg(reg[2], &data->divnint_8_7, IDTXP_DIVN_INT_8_7_MASK);
 	get_from_reg(reg[2], &data->icp_value, IDTXP_ICP_VALUE_MASK);
 	get_from_reg(reg[2], (u8*)&data->pll_mode, IDTXP_PLL_MODE_MASK);
-	get_from_reg(reg[3], (u8*)&data->divnfrac, 0xFF);
+	data->divnfrac = reg[3];
 	get_from_reg(reg[4], &data->divnfrac_15_8, 0XFF);
 	get_from_reg(reg[5], &data->divnfrac_23_16, 0xFF);
 
 	data->divo |= (data->divo_8 << 8);
-	data->divnint |= (data->divnint_8_7);
+	data->divnint = divnint_6_0 | (data->divnint_8_7 << 7);
 	data->divnfrac |= (data->divnfrac_15_8 << 8) |
 			(data->divnfrac_23_16 << 16);
+	data->trim_valid = false;
 
-	dev_info(&client->dev, "idtxp_get_divs_and_icp: [0x10-0x15] \
+	dev_dbg(&client->dev, "idtxp_decode_divs: [0x10-0x15] \
 			%02x %02x %02x %02x %02x %02x\n",
 			reg[0], reg[1], reg[2], reg[3], reg[4], reg[5]);
-	return 0;
 }
 
 /**
@@ -346,148 +732,193 @@ static int idtxp_get_divs_and_icp(struct clk_idtxp *data)
 static int idtxp_get_defaults(struct clk_idtxp *data)
 {
 	int err;
-	
-	err = idtxp_get_divs_and_icp(data);
-	if (err)
-		return err;
 
-	err = idtxp_get_xo_settings(data);
+	/* Both banks at once, served by the regmap cache */
+	err = idtxp_read_regs(data, IDTXP_REG_DIVO_7_0,
+			      IDTXP_REG_HSPI2C_CMOS +
+			      NUM_MISCELLANEOUS_REGISTERS -
+			      IDTXP_REG_DIVO_7_0);
 	if (err)
 		return err;
 
+	idtxp_decode_divs(data);
+	idtxp_decode_xo_settings(data);
+
 	return 0;
 }
 
 /**
- * idtxp_calc_divs() - Calculates the values of dividers.
+ * idtxp_rate_cache_flush() - Drop all the solved settings.
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
- * 
- * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_calc_divs(struct clk_idtxp *data)
+static void idtxp_rate_cache_flush(struct clk_idtxp *data)
 {
-	//int err;
-	bool is_int = false;
-	u32 pfd;
-	u64 rem;
-	struct i2c_client *client = data->i2c_client;
+	memset(data->rate_cache, 0, sizeof(data->rate_cache));
+}
 
-	/*
-	 * Output Divider = INT(1 + 6860 / Fout)
-	 * Fvco = Fout * Output Divider
-	 * Feedback Divider = Fvco / (Fcrystal * Doubler)
-	 */
-	data->divnfrac = 0;
-	pfd = data->fxtal * (data->xo.dblr_dis ? 1 : 2);
-	dev_info(&client->dev, "idtxp_calc_divs: [pfd] %u\n", pfd);
-	data->divo = 1 + div_u64(FVCO_MIN, data->req_freq);
-	while (data->divo < DIVO_MAX) {
-		data->fvco = (u64)data->req_freq * (u64)data->divo;
+/**
+ * idtxp_update_pfd() - Cache the phase detector frequency and its reciprocal.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Must be called again whenever fxtal or xo.dblr_dis changes.
+ */
+static void idtxp_update_pfd(struct clk_idtxp *data)
+{
+	idtxp_solver_set_pfd(&data->solver, data->fxtal, data->xo.dblr_dis);
+	idtxp_rate_cache_flush(data);
+}
 
-		dev_info(&client->dev,
-			 "idtxp_calc_divs: [fvco] %llu\n", 
-			 data->fvco);
+/**
+ * idtxp_update_rate() - Derive the output rate from the current dividers.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Keeps the output as the exact fraction rate_num / rate_den Hz, act_freq
+ * as that rounded to the nearest Hz and scaled_ppm as its error against
+ * req_freq. Must follow any change of the divider registers or of pfd.
+ */
+static void idtxp_update_rate(struct clk_idtxp *data)
+{
+	u64 ref;
 
-		if (data->fvco > FVCO_MAX)
-			break;
-		data->divnint = div64_u64_rem(data->fvco, pfd, &rem);
+	if (!data->divo) {
+		data->rate_num = 0;
+		data->rate_den = 1;
+		data->act_freq = 0;
+		return;
+	}
 
-		dev_info(&client->dev,
-			 "idtxp_calc_divs: [divnint] %u\n", 
-			 data->divnint);
+	data->rate_den = (u64)data->divo << DIVN_FRAC_BITS;
+	data->rate_num = data->solver.pfd * idtxp_divn_total(data->divnint,
+							     data->divnfrac);
+	data->act_freq = div64_u64(data->rate_num + data->rate_den / 2,
+				   data->rate_den);
 
-		if (data->divnint < DIVN_MIN)
-			continue;
-		if (data->divnint > DIVN_MAX)
-			break;
-		if (rem == 0) {
-			is_int = true;
-			break;
-		}
-		data->divo++;
+	if (data->req_freq) {
+		ref = (u64)data->req_freq * data->rate_den;
+		data->scaled_ppm = idtxp_scaled_ppm(data->rate_num - ref, ref);
 	}
+}
 
-	/*
-	 * FBInt = INT(Feedback Divider)
-	 * FBFrac = Feedback Divider - INT(Feedback Divider)
-	 * FBFrac bits = INT(0.5 + FBFrac * 2 ^ 24)
-	 * 
-	 * FBFrac <  0.5 -> FBInt
-	 * FBFrac >= 0.5 -> FBInt + 1
-	 */
-	if (!is_int) {
-		dev_info(&client->dev, "IS_FRAC\n");
-		data->divo = 1 + div_u64(FVCO_MIN, data->req_freq);
-		data->fvco = (u64)data->req_freq * (u64)data->divo;
+static void idtxp_free_int_rates(void *int_rates)
+{
+	kvfree(int_rates);
+}
 
-		dev_info(&client->dev,
-			 "idtxp_calc_divs: [fvco] %llu\n", 
-			 data->fvco);
+/**
+ * idtxp_build_int_rates() - Build the table of integer mode frequencies.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * See idtxp_int_rates_fill(), limited to min_freq and max_freq. Depends on
+ * pfd, so it has to follow idtxp_update_pfd(). The table is filled in room
+ * for every candidate, then copied into one sized for the rates kept after
+ * deduplication.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_build_int_rates(struct clk_idtxp *data)
+{
+	struct device *dev = &data->i2c_client->dev;
+	struct idtxp_int_rate *fill, *tbl;
+	unsigned int max, num;
+	int err;
+
+	if (!data->solver.pfd)
+		return -EINVAL;
 
-		data->divnint = div64_u64_rem(data->fvco, pfd, &rem);
+	max = idtxp_int_rates_max(&data->solver);
+	if (!max)
+		return -ERANGE;
 
-		dev_info(&client->dev,
-			 "idtxp_calc_divs: [divnint] %u\n", 
-			 data->divnint);
+	fill = kvmalloc_array(max, sizeof(*fill), GFP_KERNEL);
+	if (!fill)
+		return -ENOMEM;
 
-		data->divnfrac = div64_u64_rem(rem << 24, pfd, &rem);
-		if (div64_u64(rem * 10, pfd) >= 5) {
-			data->divnfrac += 1;
-		}
-		if ((data->divnfrac * 10) >> 24 >= 5) {
-			data->divnint += 1;
-		}
+	num = idtxp_int_rates_fill(&data->solver, data->min_freq,
+				   data->max_freq, fill);
+	if (!num) {
+		kvfree(fill);
+		return -ERANGE;
 	}
 
-	update_divis_regs(data);
+	tbl = kvmalloc_array(num, sizeof(*tbl), GFP_KERNEL);
+	if (tbl)
+		memcpy(tbl, fill, num * sizeof(*tbl));
+	kvfree(fill);
+	if (!tbl)
+		return -ENOMEM;
+
+	err = devm_add_action_or_reset(dev, idtxp_free_int_rates, tbl);
+	if (err)
+		return err;
 
-	dev_info(&client->dev,
-		 "idtxp_calc_divs: [req_freq] %u\n",
-		 data->req_freq);
-	dev_info(&client->dev, 
-		 "idtxp_calc_divs: [divo] %u\n", 
-		 data->divo);
-	dev_info(&client->dev,
-		 "idtxp_calc_divs: [fvco] %llu\n", 
-		 data->fvco);
-	dev_info(&client->dev,
-		 "idtxp_calc_divs: [divnint] %u\n", 
-		 data->divnint);
-	dev_info(&client->dev,
-		 "idtxp_calc_divs: [divnfrac] %u\n", 
-		 data->divnfrac);
+	data->solver.int_rates = tbl;
+	data->solver.num_int_rates = num;
+
+	dev_info(dev, "%u integer mode frequencies\n", num);
 
 	return 0;
 }
 
 /**
- * idtxp_calc_charge_pump() - Calculate the charge pump values.
- * 			
+ * idtxp_apply_divs() - Make a set of solved dividers the current ones.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @divs:	The solved dividers.
+ */
+static void idtxp_apply_divs(struct clk_idtxp *data,
+			     const struct idtxp_divs *divs)
+{
+	data->divo = divs->divo;
+	data->divnint = divs->divnint;
+	data->divnfrac = divs->divnfrac;
+	data->fvco = divs->fvco;
+	data->scaled_ppm = divs->scaled_ppm;
+	data->trim_valid = false;
+
+	update_divis_regs(data);
+}
+
+/**
+ * idtxp_calc_divs() - Calculates the values of dividers.
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
  * 
  * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_calc_charge_pump(struct clk_idtxp *data)
+static int idtxp_calc_divs(struct clk_idtxp *data)
 {
+	int err;
+	struct idtxp_divs divs;
 	struct i2c_client *client = data->i2c_client;
 
-	if (data->fvco < 7000000000LL) {
-		data->icp_value = 5;
-	} else if (7000000000LL <= data->fvco &&
-		data->fvco < 7400000000LL) {
-		data->icp_value = 4;
-	} else if (7400000000LL <= data->fvco &&
-		data->fvco < 7800000000LL) {
-		data->icp_value = 3;
-	} else {
-		data->icp_value = 2;
+	err = idtxp_find_divs(&data->solver, data->req_freq, &divs);
+	if (err) {
+		dev_err(&client->dev,
+			"no dividers for %u Hz with pfd %u Hz (%i)\n",
+			data->req_freq, data->solver.pfd, err);
+		return err;
 	}
 
-	dev_info(&client->dev,
-		 "idtxp_calc_charge_pump: [icp_value] %u\n",
-		 data->icp_value);
+	idtxp_apply_divs(data, &divs);
+
+	return 0;
+}
+
+/**
+ * idtxp_calc_charge_pump() - Calculate the charge pump values.
+ * 			
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * 
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_calc_charge_pump(struct clk_idtxp *data)
+{
+	data->icp_value = idtxp_charge_pump(data->fvco);
 
 	return 0;
 }
@@ -501,65 +932,72 @@ static int idtxp_calc_charge_pump(struct clk_idtxp *data)
  */
 static int idtxp_calc_xo_settings(struct clk_idtxp *data)
 {
-	int err = 0;
+	int err;
 	struct i2c_client *client = data->i2c_client;
 
-	if (40000000 <= data->fxtal && data->fxtal <= 80000000) {
-		data->xo.dblr_dis = 0x0;
-		data->xo.gm = 0x2;
-		data->xo.cap_x1 = 0x3C;
-		data->xo.ampslice = 0x1;
-		data->xo.cap_x2 = 0x2;
-		data->xo.ot_dis = 0x1;
-		data->xo.ot_res = 0x0;
-	} else if (100000000 <= data->fxtal && data->fxtal < 140000000) {
-		data->xo.dblr_dis = 0x1;
-		data->xo.gm = 0x2;
-		data->xo.cap_x1 = 0x15;
-		data->xo.ampslice = 0x0C;
-		data->xo.cap_x2 = 0x5;
-		data->xo.ot_dis = 0x0;
-		data->xo.ot_res = 0x5;
-	} else if (140000000 <= data->fxtal && data->fxtal <= 166000000) {
-		data->xo.dblr_dis = 0x1;
-		data->xo.gm = 0x3;
-		data->xo.cap_x1 = 0x15;
-		data->xo.ampslice = 0x0C;
-		data->xo.cap_x2 = 0x5;
-		data->xo.ot_dis = 0x0;
-		data->xo.ot_res = 0x3;
-	} else {
+	err = idtxp_xo_settings(data->fxtal, &data->xo);
+	if (err)
 		dev_err(&client->dev, "Error: wrong XO frequency");
-		err = -EINVAL;
-	}
 
 	return err;
 }
 
+/**
+ * idtxp_trigger() - Write a trigger control command.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @reg:	IDTXP_REG_CONTROL or IDTXP_REG_FREQ_CHG.
+ * @val:	Command value.
+ *
+ * The trigger registers are commands, not state, so they bypass the
+ * register image.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_trigger(struct clk_idtxp *data, unsigned int reg, u8 val)
+{
+	trace_idtxp_trigger(&data->i2c_client->dev, reg, val);
+	return regmap_write(data->regmap, reg, val);
+}
+
+/**
+ * idtxp_nvm_snapshot() - Take the register image as the NVM contents.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * The device loads its registers from NVM at power up, so the readback
+ * of probe is what NVM holds, unless the registers were reprogrammed
+ * since, e.g. before a warm reboot. In that case the next commit
+ * writes NVM even if it already matched. After that, NVM holds the
+ * registers as of the last commit, see idtxp_nvm_commit().
+ */
+static void idtxp_nvm_snapshot(struct clk_idtxp *data)
+{
+	memcpy(data->nvm_regs, data->regs, NUM_CONFIG_REGISTERS);
+	bitmap_copy(data->nvm_valid, data->regs_valid, NUM_CONFIG_REGISTERS);
+}
+
 /**
  * idtxp_setup() - Write the ram registers into the device settings
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
  * 
+ * NVM is left alone, only idtxp_nvm_commit() writes it, as this runs on
+ * every rate change, relock and glide step.
+ *
  * Return: 0 on success, negative errno otherwise.
  */
 static int idtxp_setup(struct clk_idtxp *data)
 {
 	int err;
 
-	err = regmap_write(data->regmap, IDTXP_REG_CONTROL, 0x00);
-	if (err)
-		return err;
-	err = regmap_write(data->regmap, IDTXP_REG_CONTROL, 0x20);
-	if (err)
-		return err;
-	err = regmap_write(data->regmap, IDTXP_REG_CONTROL, 0x00);
+	err = idtxp_trigger(data, IDTXP_REG_CONTROL, 0x00);
 	if (err)
 		return err;
-	err = regmap_write(data->regmap, IDTXP_REG_CONTROL, 0x01);
+	err = idtxp_trigger(data, IDTXP_REG_CONTROL, 0x01);
 	if (err)
 		return err;
-	err = regmap_write(data->regmap, IDTXP_REG_CONTROL, 0x00);
+	err = idtxp_trigger(data, IDTXP_REG_CONTROL, 0x00);
 	if (err)
 		return err;
 
@@ -567,68 +1005,441 @@ static int idtxp_setup(struct clk_idtxp *data)
 }
 
 /**
- * idtxp_write_divs_settings() - Write dividers value into registers
+ * idtxp_pm_get() - Resume the device for a register access.
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
- * 
+ *
  * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_write_divs_settings(struct clk_idtxp *data)
+static int idtxp_pm_get(struct clk_idtxp *data)
 {
-	int err, i;
-	u8 reg[NUM_FREQ_REGISTERS];
-	struct reg_sequence reg_seq[NUM_FREQ_REGISTERS];
-	struct i2c_client *client = data->i2c_client;
+	int err;
 
-	err = regmap_bulk_read(data->regmap, IDTXP_REG_DIVO_7_0,
-		reg, ARRAY_SIZE(reg));
-	
-	update_divis_regs(data);
-	
-	set_to_reg(&reg[0], (u8)data->divo, 0xFF);
-	set_to_reg(&reg[1], data->divo_8, IDTXP_DIVO_8_MASK);
-	set_to_reg(&reg[1], (u8)data->divnint, IDTXP_DIVN_INT_6_0_MASK);
-	set_to_reg(&reg[2], (u8)data->icp_offst_en, IDTXP_ICP_OFFSET_EN_MASK);
-	set_to_reg(&reg[2], data->divnint_8_7, IDTXP_DIVN_INT_8_7_MASK);
+	err = pm_runtime_get_sync(&data->i2c_client->dev);
+	if (err < 0) {
+		pm_runtime_put_noidle(&data->i2c_client->dev);
+		return err;
+	}
+
+	return 0;
+}
+
+/**
+ * idtxp_pm_put() - Let the device autosuspend after a register access.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ */
+static void idtxp_pm_put(struct clk_idtxp *data)
+{
+	pm_runtime_mark_last_busy(&data->i2c_client->dev);
+	pm_runtime_put_autosuspend(&data->i2c_client->dev);
+}
+
+/**
+ * idtxp_reg_differs_from_nvm() - Tell if a register differs from NVM.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @reg:	The register, whose value in regs is known.
+ *
+ * Return: true if the register differs from NVM or its NVM value is
+ * unknown, false for the trigger registers.
+ */
+static bool idtxp_reg_differs_from_nvm(struct clk_idtxp *data,
+				       unsigned int reg)
+{
+	/* commands, not state */
+	if (reg == IDTXP_REG_CONTROL || reg == IDTXP_REG_FREQ_CHG)
+		return false;
+
+	return !test_bit(reg, data->nvm_valid) ||
+	       data->regs[reg] != data->nvm_regs[reg];
+}
+
+/**
+ * idtxp_nvm_differs() - Tell if committing would change the NVM contents.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Return: true if a known register differs from NVM or its NVM value is
+ * unknown.
+ */
+static bool idtxp_nvm_differs(struct clk_idtxp *data)
+{
+	unsigned int reg;
+
+	for_each_set_bit(reg, data->regs_valid, NUM_CONFIG_REGISTERS)
+		if (idtxp_reg_differs_from_nvm(data, reg))
+			return true;
+
+	return false;
+}
+
+/**
+ * idtxp_nvm_commit() - Make the device power up in its current state.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Copies the registers to NVM, so the next boot finds the device already
+ * programmed and probe writes nothing. It is the only writer of NVM.
+ * NVM wears out, so nothing is written if it already holds the
+ * registers, and the copy is refused while the output is settling.
+ *
+ * NVM itself cannot be read. What it holds is known from the readback of
+ * probe and the commits since, see idtxp_nvm_snapshot().
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_nvm_commit(struct clk_idtxp *data)
+{
+	int err;
+
+	err = idtxp_pm_get(data);
+	if (err)
+		return err;
+
+	mutex_lock(&data->lock);
+
+	if (data->suspended || data->glide_active ||
+	    !completion_done(&data->pll_locked)) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	err = idtxp_commit_regs(data);
+	if (err || !idtxp_nvm_differs(data))
+		goto out;
+
+	err = idtxp_trigger(data, IDTXP_REG_CONTROL, IDTXP_NVMCP_TO_NVM_MASK);
+	if (err)
+		goto out;
+	err = idtxp_trigger(data, IDTXP_REG_CONTROL, 0x00);
+	if (err)
+		goto out;
+	msleep(IDTXP_NVM_PROG_MS);
+
+	idtxp_nvm_snapshot(data);
+	data->nvm_writes++;
+	dev_info(&data->i2c_client->dev, "registers committed to NVM\n");
+out:
+	mutex_unlock(&data->lock);
+	idtxp_pm_put(data);
+
+	return err;
+}
+
+/**
+ * idtxp_encode_divs() - Encode the dividers into register values
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * 
+ * Fills div_regs, keeping the bits of 0x10-0x15 not owned by the dividers
+ * or the charge pump as they are in the register image.
+ */
+static void idtxp_encode_divs(struct clk_idtxp *data)
+{
+	u8 *reg = data->div_regs;
+
+	memcpy(reg, &data->regs[IDTXP_REG_DIVO_7_0], NUM_FREQ_REGISTERS);
+	update_divis_regs(data);
+	
+	set_to_reg(&reg[0], (u8)data->divo, 0xFF);
+	set_to_reg(&reg[1], data->divo_8, IDTXP_DIVO_8_MASK);
+	set_to_reg(&reg[1], (u8)data->divnint, IDTXP_DIVN_INT_6_0_MASK);
+	set_to_reg(&reg[2], (u8)data->icp_offst_en, IDTXP_ICP_OFFSET_EN_MASK);
+	set_to_reg(&reg[2], data->divnint_8_7, IDTXP_DIVN_INT_8_7_MASK);
 	set_to_reg(&reg[2], data->icp_value, IDTXP_ICP_VALUE_MASK);
 	set_to_reg(&reg[2], (u8)data->pll_mode, IDTXP_PLL_MODE_MASK);
 	set_to_reg(&reg[3], (u8)data->divnfrac, 0xFF);
 	set_to_reg(&reg[4], data->divnfrac_15_8, 0xFF);
 	set_to_reg(&reg[5], data->divnfrac_23_16, 0xFF);
+}
 
-	dev_info(&client->dev, "idtxp_write_divs_settings: [0x10-0x15] \
-			%02x %02x %02x %02x %02x %02x\n",
-			reg[0], reg[1], reg[2], reg[3], reg[4], reg[5]);
-
-	for (i = 0; i < NUM_FREQ_REGISTERS; i++) {
-		reg_seq[i].reg = IDTXP_REG_DIVO_7_0 + i;
-		reg_seq[i].def = reg[i];
+/**
+ * idtxp_solve_rate() - Get the settings for req_freq, solving if needed.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Looks req_freq up in the rate cache first. On a miss the dividers and
+ * charge pump are calculated and encoded, then stored in place of the
+ * least recently used entry.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_solve_rate(struct clk_idtxp *data)
+{
+	int err, i;
+	struct idtxp_rate_cache_entry *entry, *victim = data->rate_cache;
+
+	data->rate_cache_tick++;
+
+	for (i = 0; i < IDTXP_RATE_CACHE_SIZE; i++) {
+		entry = &data->rate_cache[i];
+		if (entry->req_freq == data->req_freq &&
+		    entry->fxtal == data->fxtal &&
+		    entry->dblr_dis == data->xo.dblr_dis) {
+			entry->last_use = data->rate_cache_tick;
+			data->rate_cache_hits++;
+
+			idtxp_apply_divs(data, &entry->divs);
+			data->icp_value = entry->icp_value;
+			memcpy(data->div_regs, entry->regs,
+			       NUM_FREQ_REGISTERS);
+			trace_idtxp_solve(&data->i2c_client->dev,
+					  data->req_freq, &entry->divs,
+					  entry->icp_value, true);
+			return 0;
+		}
+		if (entry->last_use < victim->last_use)
+			victim = entry;
 	}
-	err = regmap_multi_reg_write(data->regmap, reg_seq, NUM_FREQ_REGISTERS);
+
+	data->rate_cache_misses++;
+
+	err = idtxp_calc_divs(data);
+	if (err)
+		return err;
+
+	err = idtxp_calc_charge_pump(data);
 	if (err)
 		return err;
 
-	dev_info(&client->dev, "idtxp_write_divs_settings: okay\n");
+	idtxp_encode_divs(data);
+
+	victim->req_freq = data->req_freq;
+	victim->fxtal = data->fxtal;
+	victim->dblr_dis = data->xo.dblr_dis;
+	victim->last_use = data->rate_cache_tick;
+	victim->divs.divo = data->divo;
+	victim->divs.divnint = data->divnint;
+	victim->divs.divnfrac = data->divnfrac;
+	victim->divs.fvco = data->fvco;
+	victim->divs.scaled_ppm = data->scaled_ppm;
+	victim->icp_value = data->icp_value;
+	memcpy(victim->regs, data->div_regs, NUM_FREQ_REGISTERS);
+
+	trace_idtxp_solve(&data->i2c_client->dev, data->req_freq,
+			  &victim->divs, victim->icp_value, false);
 
 	return 0;
 }
 
 /**
- * idtxp_write_xo_settings() - Write XO settings into registers
+ * idtxp_solve_preset_list() - Solve and encode the rates of presets.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @presets:	The presets, with their rate set.
+ * @num:	The number of presets.
+ *
+ * Leaves the current dividers as they were. A preset that does not solve
+ * is left unused, the others are solved all the same.
+ *
+ * Return: 0 on success, the error of the first preset that does not solve
+ * otherwise.
+ */
+static int idtxp_solve_preset_list(struct clk_idtxp *data,
+				   struct idtxp_preset *presets,
+				   unsigned int num)
+{
+	struct idtxp_divs cur = {
+		.divo = data->divo,
+		.divnint = data->divnint,
+		.divnfrac = data->divnfrac,
+		.fvco = data->fvco,
+		.scaled_ppm = data->scaled_ppm,
+	};
+	u32 req_freq = data->req_freq;
+	u8 icp_value = data->icp_value;
+	bool trim_valid = data->trim_valid;
+	struct idtxp_preset *preset;
+	unsigned int i;
+	int err, ret = 0;
+
+	for (i = 0; i < num; i++) {
+		preset = &presets[i];
+		data->req_freq = preset->rate;
+
+		err = idtxp_calc_divs(data);
+		if (!err)
+			err = idtxp_calc_charge_pump(data);
+		if (err) {
+			preset->act_rate = 0;
+			if (!ret)
+				ret = err;
+			continue;
+		}
+		idtxp_encode_divs(data);
+
+		preset->divs.divo = data->divo;
+		preset->divs.divnint = data->divnint;
+		preset->divs.divnfrac = data->divnfrac;
+		preset->divs.fvco = data->fvco;
+		preset->divs.scaled_ppm = data->scaled_ppm;
+		preset->act_rate = idtxp_divs_rate(&data->solver, &preset->divs);
+		preset->icp_value = data->icp_value;
+		memcpy(preset->regs, data->div_regs, NUM_FREQ_REGISTERS);
+	}
+
+	data->req_freq = req_freq;
+	idtxp_apply_divs(data, &cur);
+	data->icp_value = icp_value;
+	data->trim_valid = trim_valid;
+
+	return ret;
+}
+
+/**
+ * idtxp_solve_presets() - Solve and encode every preset rate.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Covers the prestaged rate too. Leaves the current dividers as they
+ * were. Must be called again whenever the rate cache is flushed, as the
+ * encodings depend on the same state.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_solve_presets(struct clk_idtxp *data)
+{
+	if (data->prestage_valid &&
+	    idtxp_solve_preset_list(data, &data->prestage, 1))
+		data->prestage_valid = false;
+
+	return idtxp_solve_preset_list(data, data->presets,
+				       data->num_presets);
+}
+
+/**
+ * idtxp_find_preset() - Look a rate up in the presets.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	Either the rate listed in DT or the one it generates (in Hz).
+ *
+ * The prestaged rate is looked up last.
+ *
+ * Return: the preset, NULL if there is none for @rate.
+ */
+static const struct idtxp_preset *idtxp_find_preset(struct clk_idtxp *data,
+						     unsigned long rate)
+{
+	unsigned int i;
+
+	for (i = 0; i < data->num_presets; i++)
+		if (data->presets[i].act_rate &&
+		    (data->presets[i].rate == rate ||
+		     data->presets[i].act_rate == rate))
+			return &data->presets[i];
+
+	if (data->prestage_valid &&
+	    (data->prestage.rate == rate || data->prestage.act_rate == rate))
+		return &data->prestage;
+
+	return NULL;
+}
+
+/**
+ * idtxp_prestage() - Solve the settings of the next rate ahead of time.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The rate expected next (in Hz), already checked against
+ *		min and max_freq.
+ *
+ * The device has a single frequency bank, so only the solving and the
+ * encoding move ahead of the rate change. At the switch, the divider
+ * bytes that differ are written as for a preset. A preset rate is not
+ * prestaged, it already is.
+ *
+ * Must be called with the lock held.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_prestage(struct clk_idtxp *data, unsigned long rate)
+{
+	int err;
+
+	if (idtxp_find_preset(data, rate))
+		return 0;
+
+	data->prestage.rate = rate;
+	err = idtxp_solve_preset_list(data, &data->prestage, 1);
+	data->prestage_valid = !err;
+
+	return err;
+}
+
+/**
+ * idtxp_hint_rate() - Prestage the rate a user expects next.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The rate expected next (in Hz).
+ *
+ * The hint comes from IDTXP_IOC_PRESTAGE or the debugfs prestage file.
+ * Rounding a rate through the clk framework is no hint, it is a query
+ * made for many other reasons.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_hint_rate(struct clk_idtxp *data, u32 rate)
+{
+	int err;
+
+	if (rate < data->min_freq || rate > data->max_freq)
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+	err = idtxp_prestage(data, rate);
+	mutex_unlock(&data->lock);
+
+	return err;
+}
+
+/**
+ * idtxp_rate_is_set() - Tell if the dividers already generate a rate.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The rate (in Hz).
+ *
+ * Compares what would be programmed for @rate with the decoded dividers
+ * and charge pump, so probe can leave alone a device that already runs
+ * at its rate.
+ *
+ * Return: true if programming @rate would change nothing.
+ */
+static bool idtxp_rate_is_set(struct clk_idtxp *data, unsigned long rate)
+{
+	struct idtxp_divs divs;
+
+	if (idtxp_find_divs(&data->solver, rate, &divs))
+		return false;
+
+	return divs.divo == data->divo && divs.divnint == data->divnint &&
+	       divs.divnfrac == data->divnfrac &&
+	       idtxp_charge_pump(divs.fvco) == data->icp_value;
+}
+
+/**
+ * idtxp_write_divs_settings() - Write dividers value into registers
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
  * 
  * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_write_xo_settings(struct clk_idtxp *data)
+static int idtxp_write_divs_settings(struct clk_idtxp *data)
+{
+	idtxp_stage_regs(data, IDTXP_REG_DIVO_7_0, data->div_regs,
+			 NUM_FREQ_REGISTERS);
+	return idtxp_commit_regs(data);
+}
+
+/**
+ * idtxp_stage_xo_settings() - Stage XO settings in the register image
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ */
+static void idtxp_stage_xo_settings(struct clk_idtxp *data)
 {
-	int err, i;
 	u8 reg[NUM_MISCELLANEOUS_REGISTERS];
-	struct reg_sequence reg_seq[NUM_MISCELLANEOUS_REGISTERS];
-	struct i2c_client *client = data->i2c_client;
 
-	err = regmap_bulk_read(data->regmap, IDTXP_REG_HSPI2C_CMOS,
-		reg, ARRAY_SIZE(reg));
+	memcpy(reg, &data->regs[IDTXP_REG_HSPI2C_CMOS], sizeof(reg));
 	
 	set_to_reg(&reg[0], (u8)data->xo.hsp_i2c_en, IDTXP_HSPI2C_EN);
 	set_to_reg(&reg[0], (u8)data->xo.cmos_en, IDTXP_CMOS_EN);
@@ -648,47 +1459,34 @@ static int idtxp_write_xo_settings(struct clk_idtxp *data)
 	set_to_reg(&reg[7], (u8)data->xo.ot_dis, IDTXP_OT_DIS_MASK);
 	set_to_reg(&reg[7], data->xo.ot_res, IDTXP_OT_RES_MASK);
 
-	dev_info(&client->dev, "idtxp_write_xo_settings: [0x50-0x57] \
-			%02x %02x %02x %02x %02x %02x %02x %02x\n",
-			reg[0], reg[1], reg[2], reg[3],
-			reg[4], reg[5], reg[6], reg[7]);
-
-	for (i = 0; i < NUM_MISCELLANEOUS_REGISTERS; i++) {
-		reg_seq[i].reg = IDTXP_REG_HSPI2C_CMOS + i;
-		reg_seq[i].def = reg[i];
-	}
-	err = regmap_multi_reg_write(data->regmap,
-				reg_seq,
-				NUM_MISCELLANEOUS_REGISTERS);
-	if (err)
-		return err;
-
-	dev_info(&client->dev, "idtxp_write_xo_settings: okay\n");
-
-	return 0;
+	idtxp_stage_regs(data, IDTXP_REG_HSPI2C_CMOS, reg, sizeof(reg));
 }
 
 /**
- * idtxp_write_all_settings() - Write settings array into registers
+ * idtxp_stage_hs_i2c() - Match the HS-mode enable bit to the bus speed.
  * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
- * 
- * Return: 0 on success, negative errno otherwise.
+ *
+ * The adapter owns the bus speed, set by the clock-frequency of its DT
+ * node, and enters HS-mode per transfer with the master code. The device
+ * only has to be told to expect it, so IDTXP_HSPI2C_EN is set when the
+ * bus runs above Fast-mode Plus and cleared otherwise, leaving the device
+ * at the speed every adapter supports.
  */
-static int idtxp_write_all_settings(struct clk_idtxp *data)
+static void idtxp_stage_hs_i2c(struct clk_idtxp *data)
 {
-	int err, i;
-	struct reg_sequence reg_seq[NUM_CONFIG_REGISTERS];
+	struct i2c_client *client = data->i2c_client;
+	struct i2c_timings t = { };
+	u8 reg = data->regs[IDTXP_REG_HSPI2C_CMOS];
 
-	for (i = 0; i < NUM_CONFIG_REGISTERS; i++) {
-		reg_seq[i].reg = i;
-		reg_seq[i].def = data->settings[i];
-	}
-	err = regmap_multi_reg_write(data->regmap,
-				     reg_seq,
-				     NUM_CONFIG_REGISTERS);
+	i2c_parse_fw_timings(&client->adapter->dev, &t, false);
+	data->xo.hsp_i2c_en = t.bus_freq_hz > I2C_MAX_FAST_MODE_PLUS_FREQ;
 
-	return err;
+	set_to_reg(&reg, data->xo.hsp_i2c_en, IDTXP_HSPI2C_EN);
+	idtxp_stage_reg(data, IDTXP_REG_HSPI2C_CMOS, reg);
+
+	dev_info(&client->dev, "bus at %u Hz, HS-mode %s\n",
+		 t.bus_freq_hz, data->xo.hsp_i2c_en ? "enabled" : "disabled");
 }
 
 /**
@@ -696,6 +1494,9 @@ static int idtxp_write_all_settings(struct clk_idtxp *data)
  * @hw:			Handle between common and hardware-specific interfaces	
  * @parent_rate:	Clock frequency of parent clock	
  * 
+ * Served from the rate derived from the divider registers, see
+ * idtxp_update_rate(), so it never touches the bus.
+ *
  * Return: the frequency of the specified clock.
  */
 static unsigned long idtxp_recalc_rate(struct clk_hw *hw, 
@@ -703,298 +1504,2551 @@ static unsigned long idtxp_recalc_rate(struct clk_hw *hw,
 {
 	struct clk_idtxp *output = to_clk_idtxp(hw);
 
-	return output->req_freq;
+	return output->act_freq;
 }
 
 /**
- * idtxp_round_rate() - Get valid rate that is closest to the requested rate.
+ * idtxp_determine_rate() - Get the rate the hardware produces for a request.
  * @hw:			Handle between common and hardware-specific interfaces
- * @rate:		The rate (in Hz) for the specified clock.
- * @parent_rate:	Clock frequency of parent clock
- * 
- * Return: frequency closest to @rate the hardware can generate.
- */
-static long idtxp_round_rate(struct clk_hw *hw, unsigned long rate,
-                        unsigned long *parent_rate)
-{
-	return rate;
-}
-
-/**
- * idtxp_large_frequency_change() - 
- * @data:	The clock device structure that contains all the requested
- * 		data for outputting frequency.
- * @frequency:	The rate (in Hz) for the specified clock.
- * 
+ * @req:		Rate request, req->rate is replaced with the rate the
+ *			dividers solved for it actually generate
+ *
+ * Only runs the divider math, the bus is not touched. As the clk framework
+ * also calls it to merely query a rate, it leaves the driver state alone;
+ * the next rate is only prestaged when hinted, see idtxp_hint_rate().
+ *
  * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_large_frequency_change(struct clk_idtxp *data,
-					unsigned long frequency)
+static int idtxp_determine_rate(struct clk_hw *hw,
+				struct clk_rate_request *req)
 {
+	struct clk_idtxp *data = to_clk_idtxp(hw);
+	struct idtxp_divs divs;
+	unsigned long rate;
 	int err;
-	struct i2c_client *client = data->i2c_client;
-
-	dev_info(&client->dev, "idtxp_large_frequency_change\n");
 
-	err = idtxp_calc_divs(data);
+	rate = clamp_t(u64, req->rate, data->min_freq, data->max_freq);
+	err = idtxp_find_divs(&data->solver, rate, &divs);
 	if (err)
 		return err;
 
-	err = idtxp_calc_charge_pump(data);
-	if (err)
-		return err;
+	req->rate = idtxp_divs_rate(&data->solver, &divs);
 
-	err = idtxp_write_divs_settings(data);
-	if (err)
-		return err;
-	
-	err = idtxp_setup(data);
-	if (err)
-		return err;
+	return 0;
+}
+
+/**
+ * idtxp_hist_add() - Record the time since @start in a histogram.
+ * @hist:	The histogram.
+ * @start:	ktime_get_ns() at the start of the phase.
+ *
+ * Return: the current ktime_get_ns(), the start of the next phase.
+ */
+static u64 idtxp_hist_add(struct idtxp_hist *hist, u64 start)
+{
+	u64 now = ktime_get_ns();
+	u64 ns = now - start;
 
-	/* update the frequency with PLL lock */
-	regmap_write(data->regmap, IDTXP_REG_FREQ_CHG, 0x01);
-	regmap_write(data->regmap, IDTXP_REG_FREQ_CHG, 0x00);
+	hist->count++;
+	hist->sum_ns += ns;
+	hist->max_ns = max(hist->max_ns, ns);
+	hist->buckets[ns ? min(ilog2(ns), IDTXP_HIST_BUCKETS - 1) : 0]++;
 
-	data->act_freq= data->req_freq;
+	return now;
+}
 
-	return 0;
+/**
+ * idtxp_hist_percentile() - Upper bound of a percentile of a histogram.
+ * @hist:	The histogram.
+ * @pct:	The percentile.
+ *
+ * Return: the upper edge of the bucket holding the percentile, capped at
+ * the largest sample (in ns).
+ */
+static u64 idtxp_hist_percentile(const struct idtxp_hist *hist,
+				 unsigned int pct)
+{
+	u64 target = DIV_ROUND_UP_ULL(hist->count * pct, 100), seen = 0;
+	int i;
+
+	for (i = 0; i < IDTXP_HIST_BUCKETS - 1; i++) {
+		seen += hist->buckets[i];
+		if (seen >= target)
+			return min(BIT_ULL(i + 1) - 1, hist->max_ns);
+	}
+	return hist->max_ns;
 }
 
 /**
- * idtxp_small_frequency_change() - 
+ * idtxp_notify() - Queue an event to every open file of the device.
  * @data:	The clock device structure that contains all the requested
  * 		data for outputting frequency.
- * @frequency:	The rate (in Hz) for the specified clock.
- * 
- * Return: 0 on success, negative errno otherwise.
+ * @type:	enum idtxp_event_type
+ * @err:	0 or the negative errno the event reports.
+ *
+ * A reader that is behind loses its oldest event.
  */
-static int idtxp_small_frequency_change(struct clk_idtxp *data,
-					unsigned long frequency)
+static void idtxp_notify(struct clk_idtxp *data, u32 type, int err)
 {
-	int err;
-	struct i2c_client *client = data->i2c_client;
-
-	dev_info(&client->dev, "idtxp_small_frequency_change\n");
+	struct idtxp_event event = {
+		.timestamp_ns = ktime_get_ns(),
+		.type = type,
+		.rate = data->act_freq,
+		.err = err,
+	};
+	struct idtxp_reader *reader;
+
+	spin_lock(&data->readers_lock);
+	list_for_each_entry(reader, &data->readers, node) {
+		if (reader->count == IDTXP_EVENT_QUEUE_LEN) {
+			reader->head = (reader->head + 1) %
+				       IDTXP_EVENT_QUEUE_LEN;
+			reader->count--;
+		}
+		reader->events[(reader->head + reader->count) %
+			       IDTXP_EVENT_QUEUE_LEN] = event;
+		reader->count++;
+		wake_up_interruptible(&reader->wait);
+	}
+	spin_unlock(&data->readers_lock);
+}
 
-	err = idtxp_calc_divs(data);
+/**
+ * idtxp_wait_pll_lock() - Wait for the PLL to lock after a large change.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @start:	ktime_get_ns() when the change was triggered.
+ *
+ * Sleeps for most of the expected lock time before the first poll of
+ * LOCK_PLL, then polls at an interval starting at an eighth of it and
+ * doubling up to the whole of it. Each lock time seen moves the estimate
+ * an eighth of the way towards it, so the first poll usually succeeds.
+ *
+ * The bit is also written as a command by idtxp_setup(), so it is only
+ * polled on boards that confirm it reads back the lock state, see
+ * lock_readback. Elsewhere the whole estimate is slept instead.
+ *
+ * Return: 0 once locked, -ETIMEDOUT or another negative errno otherwise.
+ */
+static int idtxp_wait_pll_lock(struct clk_idtxp *data, u64 start)
+{
+	u64 est = data->lock_est_ns, now;
+	u64 deadline = start + IDTXP_LOCK_TIMEOUT_US * NSEC_PER_USEC;
+	unsigned long delay, max_delay;
+	unsigned int val;
+	int err;
+
+	if (!data->lock_readback) {
+		delay = max_t(u64, div_u64(est, NSEC_PER_USEC),
+			      IDTXP_LOCK_POLL_MIN_US);
+		usleep_range(delay, delay + delay / 4);
+		return 0;
+	}
+
+	delay = max_t(u64, div_u64(est * 3 / 4, NSEC_PER_USEC),
+		      IDTXP_LOCK_POLL_MIN_US);
+	usleep_range(delay, delay + delay / 4);
+
+	delay = max_t(u64, div_u64(est / 8, NSEC_PER_USEC),
+		      IDTXP_LOCK_POLL_MIN_US);
+	max_delay = max_t(u64, div_u64(est, NSEC_PER_USEC),
+			  IDTXP_LOCK_POLL_MIN_US);
+
+	for (;;) {
+		err = regmap_read(data->regmap, IDTXP_REG_CONTROL, &val);
+		if (err)
+			return err;
+		now = ktime_get_ns();
+		if (val & IDTXP_LOCK_PLL_MASK)
+			break;
+		if (now > deadline)
+			return -ETIMEDOUT;
+
+		usleep_range(delay, delay + delay / 4);
+		delay = min(delay * 2, max_delay);
+	}
+
+	data->lock_est_ns = est - est / 8 + (now - start) / 8;
+
+	return 0;
+}
+
+/**
+ * idtxp_pll_lock_result() - Complete pll_locked after a lock wait.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @err:	The result of idtxp_wait_pll_lock().
+ *
+ * The registers are written by then, so a PLL not seen locked is only
+ * warned about and recorded in pll_lock_err, rather than failing a change
+ * the device already took. pll_locked is completed either way, so the
+ * trims and commits waiting for it are not held off until the next rate
+ * change.
+ *
+ * Must be called with the lock held.
+ *
+ * Return: true once locked.
+ */
+static bool idtxp_pll_lock_result(struct clk_idtxp *data, int err)
+{
+	if (err)
+		dev_warn(&data->i2c_client->dev,
+			 "PLL not locked at %u Hz (%i)\n", data->act_freq, err);
+
+	data->pll_lock_err = err;
+	idtxp_notify(data, IDTXP_EVENT_PLL_LOCKED, err);
+	complete_all(&data->pll_locked);
+
+	return !err;
+}
+
+/**
+ * idtxp_pll_lock_done() - Wait for the PLL lock of a committed change.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @start:	ktime_get_ns() when the change was triggered.
+ *
+ * Must be called with the lock held.
+ *
+ * Return: true once locked.
+ */
+static bool idtxp_pll_lock_done(struct clk_idtxp *data, u64 start)
+{
+	return idtxp_pll_lock_result(data, idtxp_wait_pll_lock(data, start));
+}
+
+/**
+ * idtxp_relock_trigger() - Start a PLL relock to the registers written.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Must be called with the lock held. The lock wait is left to the caller,
+ * see idtxp_relock().
+ *
+ * Return: 0 once triggered, negative errno otherwise.
+ */
+static int idtxp_relock_trigger(struct clk_idtxp *data)
+{
+	int err;
+
+	reinit_completion(&data->pll_locked);
+	data->relock_seq++;
+	err = idtxp_setup(data);
+	if (err)
+		return err;
+	err = idtxp_trigger(data, IDTXP_REG_FREQ_CHG,
+			    IDTXP_LARGE_FREQ_CHG_MASK);
 	if (err)
 		return err;
+	return idtxp_trigger(data, IDTXP_REG_FREQ_CHG, 0x00);
+}
 
-	err = idtxp_calc_charge_pump(data);
+/**
+ * idtxp_relock() - Relock the PLL to the registers already written.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Must be called with the lock held.
+ *
+ * Return: 0 once triggered, negative errno otherwise.
+ */
+static int idtxp_relock(struct clk_idtxp *data)
+{
+	int err;
+
+	err = idtxp_relock_trigger(data);
 	if (err)
 		return err;
+	idtxp_pll_lock_done(data, ktime_get_ns());
+
+	return 0;
+}
+
+/**
+ * idtxp_apply_change() - Write div_regs and trigger the change.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @path:	IDTXP_PATH_LARGE to change with a PLL relock.
+ * @start:	ktime_get_ns() at the start of the write.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_apply_change(struct clk_idtxp *data, enum idtxp_path path,
+			      u64 start)
+{
+	struct idtxp_hist *hist = data->hist[path];
+	u8 trigger = path == IDTXP_PATH_LARGE ? IDTXP_LARGE_FREQ_CHG_MASK :
+						IDTXP_SMALL_FREQ_CHG_MASK;
+	int err;
 
 	err = idtxp_write_divs_settings(data);
 	if (err)
 		return err;
 
+	/* only staged, idtxp_restore() triggers the change on resume */
+	if (data->suspended) {
+		idtxp_update_rate(data);
+		return 0;
+	}
+	start = idtxp_hist_add(&hist[IDTXP_PHASE_WRITE], start);
+
 	err = idtxp_setup(data);
 	if (err)
 		return err;
-	
-	/* update the frequency without PLL lock */
-	regmap_write(data->regmap, IDTXP_REG_FREQ_CHG, 0x02);
-	regmap_write(data->regmap, IDTXP_REG_FREQ_CHG, 0x00);
+	start = idtxp_hist_add(&hist[IDTXP_PHASE_SETUP], start);
+
+	/* update the frequency, with a PLL lock unless it is a small change */
+	reinit_completion(&data->pll_locked);
+	data->relock_seq++;
+	err = idtxp_trigger(data, IDTXP_REG_FREQ_CHG, trigger);
+	if (err)
+		return err;
+	err = idtxp_trigger(data, IDTXP_REG_FREQ_CHG, 0x00);
+	if (err)
+		return err;
+	start = idtxp_hist_add(&hist[IDTXP_PHASE_TRIGGER], start);
+
+	idtxp_update_rate(data);
 
-	data->act_freq= data->req_freq;
+	if (path != IDTXP_PATH_LARGE)
+		complete_all(&data->pll_locked);
+	else if (idtxp_pll_lock_done(data, start))
+		idtxp_hist_add(&hist[IDTXP_PHASE_PLL_LOCK], start);
 
 	return 0;
 }
 
 /**
- * idtxp_set_rate() - Return the frequency being provided by the clock.
- * @hw:			Handle between common and hardware-specific interfaces
- * @rate:		The rate (in Hz) for the specified clock.
- * @parent_rate:	Clock frequency of parent clock
- * 
+ * idtxp_frequency_change() - Program req_freq and trigger the change.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @path:	IDTXP_PATH_SMALL to change without a PLL relock.
+ * @preset:	Settings solved at probe for req_freq, or NULL to solve.
+ * @start:	ktime_get_ns() once the lock was taken.
+ *
  * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_set_rate(struct clk_hw *hw, unsigned long rate,
-                        unsigned long parent_rate)
+static int idtxp_frequency_change(struct clk_idtxp *data,
+				  enum idtxp_path path,
+				  const struct idtxp_preset *preset, u64 start)
+{
+	int err;
+
+	if (preset) {
+		idtxp_apply_divs(data, &preset->divs);
+		data->icp_value = preset->icp_value;
+		memcpy(data->div_regs, preset->regs, NUM_FREQ_REGISTERS);
+	} else {
+		err = idtxp_solve_rate(data);
+		if (err)
+			return err;
+	}
+	start = idtxp_hist_add(&data->hist[path][IDTXP_PHASE_SOLVE], start);
+
+	return idtxp_apply_change(data, path, start);
+}
+
+/**
+ * idtxp_glide_end() - Finish the glide in progress.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @err:	The result of the glide.
+ *
+ * Drops the runtime PM reference the glide holds from idtxp_glide_start().
+ *
+ * Must be called with the lock held.
+ */
+static void idtxp_glide_end(struct clk_idtxp *data, int err)
+{
+	data->glide_active = false;
+	data->glide_err = err;
+	complete_all(&data->glide_done);
+	idtxp_notify(data, IDTXP_EVENT_GLIDE_DONE, err);
+	idtxp_pm_put(data);
+}
+
+/**
+ * idtxp_glide_stop() - Abort the glide in progress, if any.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * The output stays at the last step written.
+ */
+static void idtxp_glide_stop(struct clk_idtxp *data)
+{
+	mutex_lock(&data->lock);
+	if (data->glide_active)
+		idtxp_glide_end(data, -ECANCELED);
+	mutex_unlock(&data->lock);
+
+	hrtimer_cancel(&data->glide_timer);
+	cancel_work_sync(&data->glide_work);
+}
+
+/**
+ * idtxp_glide_work() - Write the next glide step.
+ * @work:	glide_work of the clock device structure.
+ *
+ * Each step keeps DIVO and only moves the fractional feedback divider by
+ * less than the small change threshold, so the PLL never relocks and the
+ * output has no gap. The next step is armed on an absolute deadline so
+ * the write latency does not add up over the glide.
+ */
+static void idtxp_glide_work(struct work_struct *work)
+{
+	struct clk_idtxp *data = container_of(work, struct clk_idtxp,
+					      glide_work);
+	struct idtxp_hist *hist = data->hist[IDTXP_PATH_GLIDE];
+	struct idtxp_divs divs;
+	u64 start, now, elapsed;
+	u32 next, delta;
+	int err;
+
+	start = ktime_get_ns();
+	mutex_lock(&data->lock);
+
+	if (!data->glide_active)
+		goto out;
+
+	delta = abs((s64)data->glide_target - data->glide_rate);
+	delta = min(delta, data->glide_step_hz);
+	if (data->glide_target > data->glide_rate)
+		next = data->glide_rate + delta;
+	else
+		next = data->glide_rate - delta;
+
+	err = idtxp_solve_frac(&data->solver, next, data->glide_divo, &divs);
+	if (err)
+		goto fail;
+
+	data->req_freq = next;
+	idtxp_apply_divs(data, &divs);
+	err = idtxp_calc_charge_pump(data);
+	if (err)
+		goto fail;
+	idtxp_encode_divs(data);
+	idtxp_hist_add(&hist[IDTXP_PHASE_SOLVE], start);
+
+	err = idtxp_apply_change(data, IDTXP_PATH_GLIDE, ktime_get_ns());
+	if (err)
+		goto fail;
+	now = idtxp_hist_add(&hist[IDTXP_PHASE_TOTAL], start);
+
+	data->glide_rate = next;
+	data->glide_steps++;
+	elapsed = now - data->glide_start_ns;
+	if (elapsed)
+		data->glide_slew = div64_u64((u64)abs((s64)data->act_freq -
+						      data->glide_start_rate) *
+					     NSEC_PER_SEC, elapsed);
+
+	if (next == data->glide_target) {
+		idtxp_glide_end(data, 0);
+		goto out;
+	}
+
+	data->glide_next = ktime_add_ns(data->glide_next,
+					data->glide_interval_ns);
+	hrtimer_start(&data->glide_timer, data->glide_next, HRTIMER_MODE_ABS);
+	goto out;
+
+fail:
+	dev_warn(&data->i2c_client->dev, "glide stopped at %u Hz (%i)\n",
+		 data->act_freq, err);
+	idtxp_glide_end(data, err);
+out:
+	mutex_unlock(&data->lock);
+}
+
+static enum hrtimer_restart idtxp_glide_timer(struct hrtimer *timer)
+{
+	struct clk_idtxp *data = container_of(timer, struct clk_idtxp,
+					      glide_timer);
+
+	/* The step sleeps on i2c, so it cannot run in the timer */
+	queue_work(system_highpri_wq, &data->glide_work);
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * idtxp_glide_start() - Glide the output to a rate without a PLL relock.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @target:	The rate to end at (in Hz).
+ * @slew:	The largest rate of change of the output (in Hz/s).
+ *
+ * The output moves in steps below the small change threshold, at most
+ * one every IDTXP_GLIDE_STEP_US, so that it never changes faster than
+ * @slew. DIVO is kept, so @target must be reachable with the current
+ * one. A set_rate or a new glide aborts the glide in progress;
+ * glide_done is completed once it is over. The device is kept resumed
+ * for the whole glide.
+ *
+ * Return: 0 if the glide was started, negative errno otherwise.
+ */
+static int idtxp_glide_start(struct clk_idtxp *data, u32 target, u32 slew)
+{
+	struct idtxp_divs divs;
+	u64 interval;
+	u32 step;
+	int err;
+
+	if (target < data->min_freq || target > data->max_freq || !slew)
+		return -EINVAL;
+	if (data->solver.int_only)
+		return -EOPNOTSUPP;
+
+	idtxp_glide_stop(data);
+
+	err = idtxp_pm_get(data);
+	if (err)
+		return err;
+
+	mutex_lock(&data->lock);
+
+	/*
+	 * A glide started since idtxp_glide_stop() is ended here, so each
+	 * glide holds exactly one runtime PM reference
+	 */
+	if (data->glide_active)
+		idtxp_glide_end(data, -ECANCELED);
+
+	/* only while the system sleeps, runtime PM was resumed above */
+	if (data->suspended) {
+		err = -EBUSY;
+		goto out;
+	}
+	if (!data->act_freq) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	err = idtxp_solve_frac(&data->solver, target, data->divo, &divs);
+	if (err)
+		goto out;
+
+	/* keep each step under the 0.05% small change threshold */
+	step = div_u64((u64)slew * IDTXP_GLIDE_STEP_US, USEC_PER_SEC);
+	step = clamp_t(u32, step, 1, div_u64((u64)data->act_freq * 4, 10000));
+	interval = div_u64((u64)step * NSEC_PER_SEC, slew);
+
+	data->glide_divo = data->divo;
+	data->glide_target = target;
+	data->glide_rate = data->act_freq;
+	data->glide_step_hz = step;
+	data->glide_interval_ns = max_t(u64, interval,
+					IDTXP_GLIDE_STEP_US * NSEC_PER_USEC);
+	data->glide_start_rate = data->act_freq;
+	data->glide_start_ns = ktime_get_ns();
+	data->glide_steps = 0;
+	data->glide_slew = 0;
+	data->glide_err = 0;
+	data->glide_active = true;
+	reinit_completion(&data->glide_done);
+
+	/* the first step is due one interval from now, like all others */
+	data->glide_next = ktime_add_ns(ns_to_ktime(data->glide_start_ns),
+					data->glide_interval_ns);
+	hrtimer_start(&data->glide_timer, data->glide_next, HRTIMER_MODE_ABS);
+out:
+	mutex_unlock(&data->lock);
+	/* on success the reference is the glide's, see idtxp_glide_end() */
+	if (err)
+		idtxp_pm_put(data);
+
+	return err;
+}
+
+/**
+ * idtxp_adjfine() - Trim the output by a fraction of a ppm.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @scaled_ppm:	The offset from the rate last set, in ppm with a 16-bit
+ *		binary fractional field.
+ *
+ * Only the feedback divider moves, and only its register bytes that
+ * change are written, then a small change is triggered. A sub-ppm trim
+ * usually rewrites DIVN_FRAC_7_0 alone. The offset is applied to the
+ * divider of the rate last set, so trims do not add up. The charge pump
+ * follows the VCO across its bands, as on a glide step.
+ *
+ * Return: 0 on success, -ERANGE if the VCO would leave its range, another
+ * negative errno otherwise.
+ */
+static int idtxp_adjfine(struct clk_idtxp *data, long scaled_ppm)
+{
+	struct idtxp_hist *hist = data->hist[IDTXP_PATH_TRIM];
+	u64 start, now, total, fvco;
+	u16 divnint;
+	u32 divnfrac;
+	int err;
+
+	if (abs(scaled_ppm) > div_u64((u64)IDTXP_TRIM_MAX_PPB << 16, 1000))
+		return -ERANGE;
+
+	err = idtxp_pm_get(data);
+	if (err)
+		return err;
+
+	start = ktime_get_ns();
+	mutex_lock(&data->lock);
+
+	if (data->suspended || data->glide_active || !data->divo ||
+	    !completion_done(&data->pll_locked)) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	if (!data->trim_valid) {
+		data->trim_base = idtxp_divn_total(data->divnint,
+						   data->divnfrac);
+		data->trim_valid = true;
+	}
+
+	/* 2^16 * 10^6 scaled ppm per unit */
+	total = data->trim_base + div64_s64((s64)data->trim_base * scaled_ppm,
+					    1000000LL << 16);
+	divnint = total >> DIVN_FRAC_BITS;
+	divnfrac = total & GENMASK(DIVN_FRAC_BITS - 1, 0);
+	if (divnfrac & BIT(DIVN_FRAC_BITS - 1))
+		divnint++;
+	fvco = mul_u64_u64_shr(data->solver.pfd, total, DIVN_FRAC_BITS);
+	if (divnint < DIVN_MIN || divnint > DIVN_MAX ||
+	    fvco < FVCO_MIN || fvco > FVCO_MAX) {
+		err = -ERANGE;
+		goto out;
+	}
+
+	data->divnint = divnint;
+	data->divnfrac = divnfrac;
+	data->fvco = fvco;
+	err = idtxp_calc_charge_pump(data);
+	if (err)
+		goto out;
+	idtxp_encode_divs(data);
+
+	err = idtxp_write_divs_settings(data);
+	if (err)
+		goto out;
+	now = idtxp_hist_add(&hist[IDTXP_PHASE_WRITE], start);
+
+	err = idtxp_trigger(data, IDTXP_REG_FREQ_CHG,
+			    IDTXP_SMALL_FREQ_CHG_MASK);
+	if (err)
+		goto out;
+	err = idtxp_trigger(data, IDTXP_REG_FREQ_CHG, 0x00);
+	if (err)
+		goto out;
+	idtxp_hist_add(&hist[IDTXP_PHASE_TRIGGER], now);
+
+	idtxp_update_rate(data);
+	data->trim_scaled_ppm = scaled_ppm;
+	data->trims++;
+	idtxp_hist_add(&hist[IDTXP_PHASE_TOTAL], start);
+out:
+	mutex_unlock(&data->lock);
+	idtxp_pm_put(data);
+
+	return err;
+}
+
+static int idtxp_ptp_adjfine(struct ptp_clock_info *ptp, long scaled_ppm)
+{
+	struct clk_idtxp *data = container_of(ptp, struct clk_idtxp,
+					      ptp_info);
+
+	return idtxp_adjfine(data, scaled_ppm);
+}
+
+/* The oscillator has no time counter, it only disciplines a frequency */
+static int idtxp_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
+{
+	return -EOPNOTSUPP;
+}
+
+static int idtxp_ptp_gettime64(struct ptp_clock_info *ptp,
+			       struct timespec64 *ts)
+{
+	return -EOPNOTSUPP;
+}
+
+static int idtxp_ptp_settime64(struct ptp_clock_info *ptp,
+			       const struct timespec64 *ts)
+{
+	return -EOPNOTSUPP;
+}
+
+static const struct ptp_clock_info idtxp_ptp_info = {
+	.owner		= THIS_MODULE,
+	.name		= "idtxp",
+	.max_adj	= IDTXP_TRIM_MAX_PPB,
+	.adjfine	= idtxp_ptp_adjfine,
+	.adjtime	= idtxp_ptp_adjtime,
+	.gettime64	= idtxp_ptp_gettime64,
+	.settime64	= idtxp_ptp_settime64,
+};
+
+/**
+ * idtxp_is_small_change() - Tell if a rate is in reach of a small change.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The rate (in Hz).
+ *
+ * Return: true if rate is within 0.05% of act_freq.
+ */
+static bool idtxp_is_small_change(struct clk_idtxp *data, unsigned long rate)
+{
+	u64 delta = abs((s64)rate - data->act_freq);
+
+	return data->act_freq && div64_u64(delta * 10000LL, data->act_freq) < 5;
+}
+
+/**
+ * idtxp_program_rate() - Program an output frequency.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The rate (in Hz), already checked against min and max_freq.
+ *
+ * @policy:	IDTXP_RATE_AUTO to pick the small change path when the
+ *		rate is close enough, or IDTXP_RATE_SMALL or _LARGE.
+ *
+ * A large change returns only once the PLL has locked to the new rate.
+ * A preset rate is sent as encoded at probe, without solving. An
+ * IDTXP_RATE_AUTO change to hint_rate takes hint_policy instead.
+ *
+ * Return: 0 on success, -ERANGE if a small change was asked for a rate
+ * too far off, another negative errno otherwise.
+ */
+static int idtxp_program_rate(struct clk_idtxp *data, unsigned long rate,
+			      enum idtxp_rate_policy policy)
 {
-	struct clk_idtxp *data = to_clk_idtxp(hw);
 	struct i2c_client *client = data->i2c_client;
+	const struct idtxp_preset *preset;
+	enum idtxp_path path;
+	u64 start, locked;
+	bool hinted;
+	int err;
 
-	dev_info(&client->dev, "idtxp_set_rate: in\n");
+	idtxp_glide_stop(data);
 
-	if (rate < data->min_freq || rate > data->max_freq) {
-		dev_err(&client->dev,
-			"request frequency %lu Hz is out of range\n", rate);
+	err = idtxp_pm_get(data);
+	if (err)
+		return err;
+
+	start = ktime_get_ns();
+	mutex_lock(&data->lock);
+
+	/* a glide started since idtxp_glide_stop() must not move the rate */
+	if (data->glide_active)
+		idtxp_glide_end(data, -ECANCELED);
+
+	/* the hint is the rounded rate, before a preset stands in for it */
+	hinted = policy == IDTXP_RATE_AUTO && rate == data->hint_rate;
+	if (hinted)
+		policy = data->hint_policy;
+
+	preset = idtxp_find_preset(data, rate);
+	if (preset)
+		rate = preset->rate;
+	if (preset == &data->prestage)
+		data->prestage_hits++;
+
+	if (policy != IDTXP_RATE_LARGE && idtxp_is_small_change(data, rate)) {
+		path = IDTXP_PATH_SMALL;
+	} else if (policy == IDTXP_RATE_SMALL) {
+		err = -ERANGE;
+		goto out;
+	} else {
+		path = IDTXP_PATH_LARGE;
+	}
+	data->req_freq = rate;
+	locked = idtxp_hist_add(&data->hist[path][IDTXP_PHASE_LOCK], start);
+
+	trace_idtxp_set_rate_start(&client->dev, rate, data->act_freq,
+				   path == IDTXP_PATH_SMALL);
+
+	err = idtxp_frequency_change(data, path, preset, locked);
+
+	trace_idtxp_set_rate_done(&client->dev, rate, data->act_freq,
+				  data->scaled_ppm, err);
+
+	if (!err)
+		idtxp_hist_add(&data->hist[path][IDTXP_PHASE_TOTAL], start);
+
+	idtxp_notify(data, IDTXP_EVENT_RATE_DONE, err);
+out:
+	if (hinted)
+		data->hint_err = err;
+	mutex_unlock(&data->lock);
+	idtxp_pm_put(data);
+
+	return err;
+}
+
+/**
+ * idtxp_rate_work() - Program the newest queued rate.
+ * @work:	rate_work of the clock device structure.
+ *
+ * Rates queued while one is being programmed replace each other, so only
+ * the last of a burst reaches the device. rate_done is completed once
+ * nothing is left to program.
+ */
+static void idtxp_rate_work(struct work_struct *work)
+{
+	struct clk_idtxp *data = container_of(work, struct clk_idtxp,
+					      rate_work);
+	unsigned long rate;
+	int err;
+
+	spin_lock(&data->pending_lock);
+	while (data->pending_rate) {
+		rate = data->pending_rate;
+		data->pending_rate = 0;
+		spin_unlock(&data->pending_lock);
+
+		err = idtxp_program_rate(data, rate, IDTXP_RATE_AUTO);
+
+		spin_lock(&data->pending_lock);
+		data->rate_err = err;
+	}
+	complete_all(&data->rate_done);
+	spin_unlock(&data->pending_lock);
+}
+
+/**
+ * idtxp_queue_rate() - Queue an output frequency for rate_work.
+ * @data:	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The rate (in Hz), already checked against min and max_freq.
+ */
+static void idtxp_queue_rate(struct clk_idtxp *data, unsigned long rate)
+{
+	spin_lock(&data->pending_lock);
+	if (data->pending_rate)
+		data->rate_coalesced++;
+	data->pending_rate = rate;
+	data->rate_requests++;
+	reinit_completion(&data->rate_done);
+	spin_unlock(&data->pending_lock);
+
+	queue_work(system_highpri_wq, &data->rate_work);
+}
+
+/**
+ * idtxp_set_rate() - Return the frequency being provided by the clock.
+ * @hw:			Handle between common and hardware-specific interfaces
+ * @rate:		The rate (in Hz) for the specified clock.
+ * @parent_rate:	Clock frequency of parent clock
+ * 
+ * In async_rate mode the rate is only queued, see idtxp_rate_work(), and
+ * rate_done tells when it has been programmed. Otherwise a large change
+ * returns only once the PLL has locked to the new rate, so the output is
+ * usable as soon as clk_set_rate() returns.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_set_rate(struct clk_hw *hw, unsigned long rate,
+                        unsigned long parent_rate)
+{
+	struct clk_idtxp *data = to_clk_idtxp(hw);
+	struct i2c_client *client = data->i2c_client;
+
+	if (rate < data->min_freq || rate > data->max_freq) {
+		dev_err(&client->dev,
+			"request frequency %lu Hz is out of range\n", rate);
+		return -EINVAL;
+	}
+
+	if (data->async_rate) {
+		idtxp_queue_rate(data, rate);
+		return 0;
+	}
+
+	return idtxp_program_rate(data, rate, IDTXP_RATE_AUTO);
+}
+
+static const struct clk_ops idtxp_clk_ops = {
+	.recalc_rate = idtxp_recalc_rate,
+	.determine_rate = idtxp_determine_rate,
+	.set_rate = idtxp_set_rate,
+};
+
+/*
+ * The register space is a dense 256 bytes, so the cache is a flat array.
+ * It is filled by a single read of the whole space when the regmap is
+ * created, which then serves every read but the volatile registers.
+ */
+static const struct regmap_config idtxp_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.cache_type = REGCACHE_FLAT,
+	.max_register = NUM_CONFIG_REGISTERS - 1,
+	.num_reg_defaults_raw = NUM_CONFIG_REGISTERS,
+	.wr_table = &idtxp_writeable_table,
+	.volatile_table = &idtxp_volatile_table,
+};
+
+/**
+ * struct idtxp_reg_write - One register write of a script.
+ * @reg:		register address
+ * @val:		value to write
+ */
+struct idtxp_reg_write {
+	u8 reg;
+	u8 val;
+};
+
+/**
+ * struct idtxp_script - Register writes applied as one batch.
+ * @num:		number of entries in writes
+ * @atomic:		the lock is also held while the PLL relocks, otherwise
+ *			it is dropped once the relock is triggered
+ * @trigger:		relock the PLL once all the writes are done
+ * @writes:		the writes, in the order given
+ */
+struct idtxp_script {
+	unsigned int num;
+	bool atomic;
+	bool trigger;
+	struct idtxp_reg_write writes[IDTXP_SCRIPT_MAX_WRITES];
+};
+
+/**
+ * idtxp_parse_script() - Parse a register script.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @buf:	The script, NUL terminated. It is modified.
+ * @script:	The script to add the writes to.
+ *
+ * Each line is an "addr val" pair in hex, or one of the keywords "atomic"
+ * and "trigger". Blank lines and anything after a '#' are ignored.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_parse_script(struct clk_idtxp *data, char *buf,
+			      struct idtxp_script *script)
+{
+	unsigned int reg, val, line_no = 0;
+	char *line, *comment;
+	int n;
+
+	while ((line = strsep(&buf, "\n"))) {
+		line_no++;
+		comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+		line = strim(line);
+
+		if (!*line)
+			continue;
+		if (!strcmp(line, "atomic")) {
+			script->atomic = true;
+			continue;
+		}
+		if (!strcmp(line, "trigger")) {
+			script->trigger = true;
+			continue;
+		}
+
+		if (sscanf(line, "%x %x%n", &reg, &val, &n) != 2 || line[n] ||
+		    reg >= NUM_CONFIG_REGISTERS || val > 0xff) {
+			dev_err(&data->i2c_client->dev,
+				"script line %u: parsing error\n", line_no);
+			return -EINVAL;
+		}
+		if (script->num == IDTXP_SCRIPT_MAX_WRITES)
+			return -E2BIG;
+
+		script->writes[script->num].reg = reg;
+		script->writes[script->num].val = val;
+		script->num++;
+	}
+
+	return 0;
+}
+
+/**
+ * idtxp_check_script() - Check that every write of a script is allowed.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @script:	The script to check.
+ *
+ * Return: 0 if the script can be applied, -EINVAL otherwise.
+ */
+static int idtxp_check_script(struct clk_idtxp *data,
+			      const struct idtxp_script *script)
+{
+	unsigned int i;
+
+	for (i = 0; i < script->num; i++) {
+		if (!regmap_check_range_table(data->regmap,
+					      script->writes[i].reg,
+					      &idtxp_writeable_table)) {
+			dev_err(&data->i2c_client->dev,
+				"script write %u: register %02x is read-only\n",
+				i, script->writes[i].reg);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * idtxp_apply_script() - Apply a checked register script.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @script:	The script to apply.
+ *
+ * The registers are staged in the image and go out as one block write
+ * per run of consecutive registers, the last value of a register
+ * written twice winning. The trigger registers are commands, so they
+ * are written afterwards in the order given. Last, if requested, the
+ * PLL is relocked to the new registers. The rate is taken from the
+ * dividers only once the triggers are written, as the device runs the
+ * old ones until then.
+ *
+ * Everything up to the relock trigger is done under one lock hold. A
+ * script not marked atomic drops the lock for the PLL lock wait.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_apply_script(struct clk_idtxp *data,
+			      const struct idtxp_script *script)
+{
+	const struct idtxp_reg_write *w;
+	bool divs = false, xo = false;
+	unsigned long seq;
+	unsigned int i;
+	u64 start;
+	int err;
+
+	err = idtxp_pm_get(data);
+	if (err)
+		return err;
+
+	mutex_lock(&data->lock);
+
+	if (data->suspended) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	for (i = 0; i < script->num; i++) {
+		w = &script->writes[i];
+		/* explicit writes reach the device even if unchanged */
+		__clear_bit(w->reg, data->regs_valid);
+		idtxp_stage_reg(data, w->reg, w->val);
+
+		divs |= w->reg >= IDTXP_REG_DIVO_7_0 &&
+			w->reg <= IDTXP_REG_DIVN_FRAC_23_16;
+		xo |= w->reg >= IDTXP_REG_HSPI2C_CMOS &&
+		      w->reg <= IDTXP_REG_XO_2;
+	}
+
+	err = idtxp_commit_regs(data);
+	if (err)
+		goto out;
+
+	/* Cached encodings include the divider and XO register contents */
+	if (divs || xo) {
+		idtxp_rate_cache_flush(data);
+		/* the ones left unused are solved at use, like any rate */
+		if (idtxp_solve_presets(data))
+			dev_warn(&data->i2c_client->dev,
+				 "presets left unused, they no longer solve\n");
+	}
+
+	for (i = 0; i < script->num; i++) {
+		w = &script->writes[i];
+		if (!regmap_check_range_table(data->regmap, w->reg,
+					      &idtxp_volatile_table))
+			continue;
+		err = idtxp_trigger(data, w->reg, w->val);
+		if (err)
+			goto out;
+	}
+
+	if (script->trigger) {
+		err = idtxp_relock_trigger(data);
+		if (err)
+			goto out;
+	}
+	start = ktime_get_ns();
+
+	/* Dividers are decoded from the register image, not the bus */
+	if (divs) {
+		idtxp_decode_divs(data);
+		idtxp_update_rate(data);
+	}
+
+	if (!script->trigger)
+		goto out;
+
+	if (script->atomic) {
+		idtxp_pll_lock_done(data, start);
+		goto out;
+	}
+
+	/* A change that comes in meanwhile owns pll_locked from then on */
+	seq = data->relock_seq;
+	mutex_unlock(&data->lock);
+	err = idtxp_wait_pll_lock(data, start);
+	mutex_lock(&data->lock);
+	if (seq == data->relock_seq)
+		idtxp_pll_lock_result(data, err);
+	err = 0;
+out:
+	mutex_unlock(&data->lock);
+	idtxp_pm_put(data);
+
+	return err;
+}
+
+/**
+ * struct idtxp_snapshot - Registers read once per open of a dump file.
+ * @data:		the device the registers were read from
+ * @regs:		all the device registers
+ */
+struct idtxp_snapshot {
+	struct clk_idtxp *data;
+	u8 regs[NUM_CONFIG_REGISTERS];
+};
+
+/**
+ * idtxp_read_snapshot() - Read all the device registers at once.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @regs:	Buffer of NUM_CONFIG_REGISTERS bytes for the registers.
+ *
+ * Only the trigger registers are volatile, all the others are served
+ * from the regmap cache, so this costs two single register reads.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_read_snapshot(struct clk_idtxp *data, u8 *regs)
+{
+	int err;
+
+	err = idtxp_pm_get(data);
+	if (err)
+		return err;
+
+	mutex_lock(&data->lock);
+	err = regmap_bulk_read(data->regmap, 0, regs, NUM_CONFIG_REGISTERS);
+	mutex_unlock(&data->lock);
+
+	idtxp_pm_put(data);
+
+	return err;
+}
+
+/**
+ * idtxp_snapshot_open() - Take the register snapshot of a dump file.
+ * @inode:		Inode of the dump file.
+ * @filp:		Open file of the dump file.
+ *
+ * The registers are only read if the file is opened for reading, so
+ * a writer does not touch the bus.
+ *
+ * Return: the snapshot, or an ERR_PTR() on failure.
+ */
+static struct idtxp_snapshot *idtxp_snapshot_open(struct inode *inode,
+						  struct file *filp)
+{
+	struct idtxp_snapshot *snap;
+	int err;
+
+	snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+	if (!snap)
+		return ERR_PTR(-ENOMEM);
+	snap->data = inode->i_private;
+
+	if (filp->f_mode & FMODE_READ) {
+		err = idtxp_read_snapshot(snap->data, snap->regs);
+		if (err) {
+			dev_err(&snap->data->i2c_client->dev,
+				"error reading the registers (%i)\n", err);
+			kfree(snap);
+			return ERR_PTR(err);
+		}
+	}
+
+	return snap;
+}
+
+static int debugfs_i2c_open(struct inode *inode, struct file *filp)
+{
+	filp->private_data = inode->i_private;
+	return 0;
+}
+
+static int debugfs_i2c_show(struct seq_file *s, void *unused)
+{
+	struct idtxp_snapshot *snap = s->private;
+	int i;
+
+	seq_puts(s, "     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f\n");
+	for (i = 0; i < NUM_CONFIG_REGISTERS; i += 16)
+		seq_printf(s, "%02x  %16ph\n", i, &snap->regs[i]);
+	seq_putc(s, '\n');
+
+	return 0;
+}
+
+/**
+ * debugfs_i2c_dump_open() - Read in all the device registers.
+ * @inode:		Inode of the i2c file.
+ * @filp:		Open file of the i2c file.
+ *
+ * The registers are read once here and every read() of this open file
+ * is served from that snapshot.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int debugfs_i2c_dump_open(struct inode *inode, struct file *filp)
+{
+	struct idtxp_snapshot *snap;
+	int err;
+
+	snap = idtxp_snapshot_open(inode, filp);
+	if (IS_ERR(snap))
+		return PTR_ERR(snap);
+
+	err = single_open(filp, debugfs_i2c_show, snap);
+	if (err)
+		kfree(snap);
+
+	return err;
+}
+
+static int debugfs_i2c_release(struct inode *inode, struct file *filp)
+{
+	struct seq_file *s = filp->private_data;
+
+	kfree(s->private);
+
+	return single_release(inode, filp);
+}
+
+/**
+ * debugfs_i2c_write() - Write a register script.
+ * @filp:		Open file to invoke ioctl method on.
+ * @user_buffer:	Buffer to read data from.
+ * @count:		Size of the buffer.
+ * @ppos:		Offset within the file.
+ *
+ * Each write() is one whole script, see idtxp_parse_script(). Nothing
+ * is written unless the whole script is valid.
+ *
+ * Return: number of bytes written, negative errno otherwise.
+ */
+static ssize_t debugfs_i2c_write(struct file *filp, 
+		const char __user *user_buffer,	size_t count, loff_t *ppos)
+{
+	struct seq_file *s = filp->private_data;
+	struct clk_idtxp *data = 
+		((struct idtxp_snapshot *)s->private)->data;
+	struct idtxp_script *script;
+	char *buf;
+	int err;
+
+	if (count > IDTXP_SCRIPT_MAX_SIZE)
+		return -EFBIG;
+
+	buf = memdup_user_nul(user_buffer, count);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	script = kzalloc(sizeof(*script), GFP_KERNEL);
+	if (!script) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	err = idtxp_parse_script(data, buf, script);
+	if (!err)
+		err = idtxp_check_script(data, script);
+	if (!err)
+		err = idtxp_apply_script(data, script);
+
+	kfree(script);
+out:
+	kfree(buf);
+
+	return err ? err : count;
+}
+
+struct file_operations debugfs_i2c_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_dump_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.write = debugfs_i2c_write,
+	.release = debugfs_i2c_release,
+};
+
+/**
+ * debugfs_i2c_bin_write() - Write a binary register list.
+ * @filp:		Open file to invoke ioctl method on.
+ * @user_buffer:	Buffer to read data from.
+ * @count:		Size of the buffer.
+ * @ppos:		Offset within the file.
+ *
+ * Each write() is one whole list of (addr, val) byte pairs, applied
+ * atomically. An optional last byte after the pairs holds flags;
+ * IDTXP_SCRIPT_BIN_TRIGGER relocks the PLL once everything is written,
+ * as the "trigger" keyword of the i2c file. Nothing is written unless
+ * every pair and flag is valid.
+ *
+ * Return: number of bytes written, negative errno otherwise.
+ */
+static ssize_t debugfs_i2c_bin_write(struct file *filp,
+				     const char __user *user_buffer,
+				     size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	struct idtxp_script *script;
+	size_t len = count;
+	u8 flags = 0;
+	int err;
+
+	if (len % sizeof(struct idtxp_reg_write)) {
+		if (get_user(flags, user_buffer + --len))
+			return -EFAULT;
+		if (flags & ~IDTXP_SCRIPT_BIN_TRIGGER)
+			return -EINVAL;
+	}
+	if (!len)
+		return -EINVAL;
+	if (len > sizeof(script->writes))
+		return -EFBIG;
+
+	script = kzalloc(sizeof(*script), GFP_KERNEL);
+	if (!script)
+		return -ENOMEM;
+
+	if (copy_from_user(script->writes, user_buffer, len)) {
+		err = -EFAULT;
+		goto out;
+	}
+	script->num = len / sizeof(struct idtxp_reg_write);
+	script->atomic = true;
+	script->trigger = flags & IDTXP_SCRIPT_BIN_TRIGGER;
+
+	err = idtxp_check_script(data, script);
+	if (!err)
+		err = idtxp_apply_script(data, script);
+out:
+	kfree(script);
+
+	return err ? err : count;
+}
+
+static const struct file_operations debugfs_i2c_bin_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.write = debugfs_i2c_bin_write,
+};
+
+static int debugfs_regs_open(struct inode *inode, struct file *filp)
+{
+	struct idtxp_snapshot *snap;
+
+	snap = idtxp_snapshot_open(inode, filp);
+	if (IS_ERR(snap))
+		return PTR_ERR(snap);
+
+	filp->private_data = snap;
+	return 0;
+}
+
+/**
+ * debugfs_regs_read() - Read the raw registers, one byte each.
+ * @filp:		Open file to invoke ioctl method on.
+ * @user_buffer:	Buffer to read data to.
+ * @count:		Size of the buffer.
+ * @ppos:		Offset within the file, the first register to read.
+ *
+ * Return: number of bytes read, negative errno otherwise.
+ */
+static ssize_t debugfs_regs_read(struct file *filp, char __user *user_buffer,
+				 size_t count, loff_t *ppos)
+{
+	struct idtxp_snapshot *snap = filp->private_data;
+
+	return simple_read_from_buffer(user_buffer, count, ppos, snap->regs,
+				       NUM_CONFIG_REGISTERS);
+}
+
+static int debugfs_regs_release(struct inode *inode, struct file *filp)
+{
+	kfree(filp->private_data);
+	return 0;
+}
+
+static const struct file_operations debugfs_regs_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_regs_open,
+	.read = debugfs_regs_read,
+	.llseek = default_llseek,
+	.release = debugfs_regs_release,
+};
+
+/**
+ * debugfs_rate_read() - Print the output rate derived from the dividers.
+ * @filp:		Open file to invoke ioctl method on.
+ * @user_buffer:	Buffer to read data from.
+ * @count:		Size of the buffer.
+ * @ppos:		Offset within the file.
+ * 
+ * Return: number of bytes read, negative errno otherwise.
+ */
+static ssize_t debugfs_rate_read(struct file *filp, char __user *user_buffer,
+				 size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	char buf[224];
+	u64 rem, hz, nhz;
+	int len;
+
+	hz = div64_u64_rem(data->rate_num, data->rate_den, &rem);
+	nhz = div64_u64(rem * NSEC_PER_SEC, data->rate_den);
+
+	len = scnprintf(buf, sizeof(buf),
+			"req_freq: %u\nact_freq: %llu.%09llu\n"
+			"rate: %llu/%llu\nscaled_ppm: %lld\n"
+			"pll_locked: %d\npll_lock_err: %d\nlock_est_ns: %llu\n",
+			data->req_freq, hz, nhz,
+			data->rate_num, data->rate_den, data->scaled_ppm,
+			completion_done(&data->pll_locked), data->pll_lock_err,
+			data->lock_est_ns);
+
+	return simple_read_from_buffer(user_buffer, count, ppos, buf, len);
+}
+
+static const struct file_operations debugfs_rate_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.read = debugfs_rate_read,
+};
+
+/*
+ * One line per path and phase with samples, followed by its non-empty
+ * buckets as "lower edge in ns: count".
+ */
+static ssize_t debugfs_latency_read(struct file *filp,
+				    char __user *user_buffer,
+				    size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	const size_t size = 4 * PAGE_SIZE;
+	const struct idtxp_hist *hist;
+	ssize_t ret;
+	char *buf;
+	int path, phase, i, len = 0;
+
+	buf = kvmalloc(size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len += scnprintf(buf + len, size - len,
+			 "path  phase      count    mean_ns     p50_ns"
+			 "     p99_ns     max_ns\n");
+
+	mutex_lock(&data->lock);
+	for (path = 0; path < IDTXP_NUM_PATHS; path++) {
+		for (phase = 0; phase < IDTXP_NUM_PHASES; phase++) {
+			hist = &data->hist[path][phase];
+			if (!hist->count)
+				continue;
+
+			len += scnprintf(buf + len, size - len,
+					 "%-5s %-7s %8llu %10llu %10llu "
+					 "%10llu %10llu\n",
+					 idtxp_path_names[path],
+					 idtxp_phase_names[phase],
+					 hist->count,
+					 div64_u64(hist->sum_ns, hist->count),
+					 idtxp_hist_percentile(hist, 50),
+					 idtxp_hist_percentile(hist, 99),
+					 hist->max_ns);
+
+			for (i = 0; i < IDTXP_HIST_BUCKETS; i++)
+				if (hist->buckets[i])
+					len += scnprintf(buf + len, size - len,
+							 "\t%10llu: %llu\n",
+							 i ? BIT_ULL(i) : 0,
+							 hist->buckets[i]);
+		}
+	}
+	mutex_unlock(&data->lock);
+
+	ret = simple_read_from_buffer(user_buffer, count, ppos, buf, len);
+	kvfree(buf);
+
+	return ret;
+}
+
+static const struct file_operations debugfs_latency_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.read = debugfs_latency_read,
+};
+
+/* Any write clears all the latency histograms */
+static ssize_t debugfs_latency_reset_write(struct file *filp,
+					   const char __user *user_buffer,
+					   size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+
+	mutex_lock(&data->lock);
+	memset(data->hist, 0, sizeof(data->hist));
+	mutex_unlock(&data->lock);
+
+	return count;
+}
+
+static const struct file_operations debugfs_latency_reset_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.write = debugfs_latency_reset_write,
+};
+
+/* Blocks until no queued rate is left, then gives act_freq and the result */
+static ssize_t debugfs_rate_wait_read(struct file *filp,
+				      char __user *user_buffer,
+				      size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	char buf[32];
+	int err, len;
+
+	err = wait_for_completion_interruptible(&data->rate_done);
+	if (err)
+		return err;
+
+	spin_lock(&data->pending_lock);
+	err = data->rate_err;
+	spin_unlock(&data->pending_lock);
+
+	len = scnprintf(buf, sizeof(buf), "%u %d\n", data->act_freq, err);
+
+	return simple_read_from_buffer(user_buffer, count, ppos, buf, len);
+}
+
+static const struct file_operations debugfs_rate_wait_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.read = debugfs_rate_wait_read,
+};
+
+/* Shows the glide in progress or the last one */
+static ssize_t debugfs_glide_read(struct file *filp, char __user *user_buffer,
+				  size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	char buf[224];
+	int len;
+
+	mutex_lock(&data->lock);
+	len = scnprintf(buf, sizeof(buf),
+			"active: %d\ntarget: %u\ncurrent: %u\n"
+			"step_hz: %u\ninterval_ns: %llu\nsteps: %llu\n"
+			"slew: %llu\nerr: %d\n",
+			data->glide_active, data->glide_target, data->act_freq,
+			data->glide_step_hz, data->glide_interval_ns,
+			data->glide_steps, data->glide_slew, data->glide_err);
+	mutex_unlock(&data->lock);
+
+	return simple_read_from_buffer(user_buffer, count, ppos, buf, len);
+}
+
+/* "<target_hz> <slew_hz_per_s>" starts a glide, "0" aborts it */
+static ssize_t debugfs_glide_write(struct file *filp,
+				   const char __user *user_buffer,
+				   size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	char buf[32];
+	u32 target, slew = 0;
+	ssize_t len;
+	int err;
+
+	len = simple_write_to_buffer(buf, sizeof(buf) - 1, ppos, user_buffer,
+				     count);
+	if (len < 0)
+		return len;
+	buf[len] = '\0';
+
+	if (sscanf(buf, "%u %u", &target, &slew) < 1)
+		return -EINVAL;
+
+	if (!target) {
+		idtxp_glide_stop(data);
+		return count;
+	}
+
+	err = idtxp_glide_start(data, target, slew);
+
+	return err ? err : count;
+}
+
+static const struct file_operations debugfs_glide_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.read = debugfs_glide_read,
+	.write = debugfs_glide_write,
+};
+
+/* Lists the presets, the one in use marked with '*' */
+static ssize_t debugfs_preset_read(struct file *filp, char __user *user_buffer,
+				   size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	const struct idtxp_preset *preset;
+	const size_t size = PAGE_SIZE;
+	unsigned int i;
+	ssize_t ret;
+	char *buf;
+	int len = 0;
+
+	buf = kvmalloc(size, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	mutex_lock(&data->lock);
+	for (i = 0; i < data->num_presets; i++) {
+		preset = &data->presets[i];
+		len += scnprintf(buf + len, size - len, "%c%u: %u %u\n",
+				 preset->rate == data->req_freq ? '*' : ' ',
+				 i, preset->rate, preset->act_rate);
+	}
+	mutex_unlock(&data->lock);
+
+	ret = simple_read_from_buffer(user_buffer, count, ppos, buf, len);
+	kvfree(buf);
+
+	return ret;
+}
+
+/* Switches to the preset of the index written */
+static ssize_t debugfs_preset_write(struct file *filp,
+				    const char __user *user_buffer,
+				    size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	unsigned int index;
+	int err;
+
+	err = kstrtouint_from_user(user_buffer, count, 0, &index);
+	if (err)
+		return err;
+	if (index >= data->num_presets)
+		return -EINVAL;
+
+	err = clk_set_rate(data->hw.clk, data->presets[index].rate);
+
+	return err ? err : count;
+}
+
+static const struct file_operations debugfs_preset_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.read = debugfs_preset_read,
+	.write = debugfs_preset_write,
+};
+
+/* Shows the prestaged rate and its encoded divider registers */
+static ssize_t debugfs_prestage_read(struct file *filp,
+				     char __user *user_buffer,
+				     size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	const struct idtxp_preset *prestage = &data->prestage;
+	char buf[160];
+	int len;
+
+	mutex_lock(&data->lock);
+	if (data->prestage_valid)
+		len = scnprintf(buf, sizeof(buf),
+				"rate: %u %u\ndivs: %u %u %u\nregs: %6ph\n"
+				"hits: %llu\n",
+				prestage->rate, prestage->act_rate,
+				prestage->divs.divo, prestage->divs.divnint,
+				prestage->divs.divnfrac, prestage->regs,
+				data->prestage_hits);
+	else
+		len = scnprintf(buf, sizeof(buf), "none\nhits: %llu\n",
+				data->prestage_hits);
+	mutex_unlock(&data->lock);
+
+	return simple_read_from_buffer(user_buffer, count, ppos, buf, len);
+}
+
+/* Prestages the rate written */
+static ssize_t debugfs_prestage_write(struct file *filp,
+				      const char __user *user_buffer,
+				      size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	u32 rate;
+	int err;
+
+	err = kstrtou32_from_user(user_buffer, count, 0, &rate);
+	if (err)
+		return err;
+
+	err = idtxp_hint_rate(data, rate);
+
+	return err ? err : count;
+}
+
+static const struct file_operations debugfs_prestage_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.read = debugfs_prestage_read,
+	.write = debugfs_prestage_write,
+};
+
+/* Tells whether a commit would copy, and what that is judged against */
+static ssize_t debugfs_nvm_commit_read(struct file *filp,
+				       char __user *user_buffer,
+				       size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	char buf[160];
+	bool differs;
+	int len;
+
+	mutex_lock(&data->lock);
+	differs = idtxp_nvm_differs(data);
+	mutex_unlock(&data->lock);
+
+	len = scnprintf(buf, sizeof(buf),
+			"pending: %s\n"
+			"against: registers read at probe or last committed, "
+			"NVM itself is not readable\n",
+			differs ? "yes" : "no");
+
+	return simple_read_from_buffer(user_buffer, count, ppos, buf, len);
+}
+
+/* Only "commit" is accepted, so a stray write does not wear out NVM */
+static ssize_t debugfs_nvm_commit_write(struct file *filp,
+					const char __user *user_buffer,
+					size_t count, loff_t *ppos)
+{
+	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
+	char buf[8];
+	ssize_t len;
+	int err;
+
+	len = simple_write_to_buffer(buf, sizeof(buf) - 1, ppos, user_buffer,
+				     count);
+	if (len < 0)
+		return len;
+	buf[len] = '\0';
+
+	if (!sysfs_streq(buf, "commit"))
+		return -EINVAL;
+
+	err = idtxp_nvm_commit(data);
+
+	return err ? err : count;
+}
+
+static const struct file_operations debugfs_nvm_commit_ops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_i2c_open,
+	.read = debugfs_nvm_commit_read,
+	.write = debugfs_nvm_commit_write,
+};
+
+/**
+ * idtxp_create_debugfs_xo() - Create the files of the decoded XO settings.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @dir:	The directory to create them in.
+ */
+static void idtxp_create_debugfs_xo(struct clk_idtxp *data,
+				    struct dentry *dir)
+{
+	struct clk_xo_setting *xo = &data->xo;
+
+	debugfs_create_bool("hsp_i2c_en", 0444, dir, &xo->hsp_i2c_en);
+	debugfs_create_bool("cmos_en", 0444, dir, &xo->cmos_en);
+	debugfs_create_bool("dblr_dis", 0444, dir, &xo->dblr_dis);
+	debugfs_create_u8("vdd_def", 0444, dir, &xo->vdd_def);
+	debugfs_create_bool("vcxo_dis", 0444, dir, &xo->vcxo_dis);
+	debugfs_create_u8("vcxo_bw", 0444, dir, &xo->vcxo_bw);
+	debugfs_create_bool("vcxo_gslope", 0444, dir, &xo->vcxo_gslope);
+	debugfs_create_u8("vcxo_gexp", 0444, dir, &xo->vcxo_gexp);
+	debugfs_create_u8("vcxo_gscale", 0444, dir, &xo->vcxo_gscale);
+	debugfs_create_bool("oe_pol_en", 0444, dir, &xo->oe_pol_en);
+	debugfs_create_u8("drv_type", 0444, dir, &xo->drv_type);
+	debugfs_create_u8("gm", 0444, dir, &xo->gm);
+	debugfs_create_u8("cap_x1", 0444, dir, &xo->cap_x1);
+	debugfs_create_u8("ampslice", 0444, dir, &xo->ampslice);
+	debugfs_create_bool("bypass", 0444, dir, &xo->bypass);
+	debugfs_create_u8("cap_x2", 0444, dir, &xo->cap_x2);
+	debugfs_create_bool("ot_dis", 0444, dir, &xo->ot_dis);
+	debugfs_create_u8("ot_res", 0444, dir, &xo->ot_res);
+}
+
+/**
+ * idtxp_create_debugfs() - Create the debugfs directory of a device.
+ * @work:	debugfs_work of the clock device structure.
+ *
+ * The directory is named after the i2c device, so that several
+ * oscillators do not collide.
+ */
+static void idtxp_create_debugfs(struct work_struct *work)
+{
+	struct clk_idtxp *data = container_of(work, struct clk_idtxp,
+					      debugfs_work);
+	struct dentry *dir;
+
+	dir = debugfs_create_dir(dev_name(&data->i2c_client->dev),
+				 idtxp_debugfs_root);
+	data->debugfs_root_dir = dir;
+	data->debugfs_i2c_file = debugfs_create_file(DEBUGFS_I2C_FILE_NAME,
+						     0644, dir, data,
+						     &debugfs_i2c_ops);
+	debugfs_create_u64(DEBUGFS_CACHE_HITS_FILE_NAME, 0444, dir,
+			   &data->rate_cache_hits);
+	debugfs_create_u64(DEBUGFS_CACHE_MISSES_FILE_NAME, 0444, dir,
+			   &data->rate_cache_misses);
+	debugfs_create_file(DEBUGFS_RATE_FILE_NAME, 0444, dir, data,
+			    &debugfs_rate_ops);
+	debugfs_create_file(DEBUGFS_LATENCY_FILE_NAME, 0444, dir, data,
+			    &debugfs_latency_ops);
+	debugfs_create_file(DEBUGFS_LATENCY_RESET_FILE_NAME, 0200, dir, data,
+			    &debugfs_latency_reset_ops);
+	debugfs_create_file(DEBUGFS_RATE_WAIT_FILE_NAME, 0444, dir, data,
+			    &debugfs_rate_wait_ops);
+	debugfs_create_u64(DEBUGFS_RATE_REQUESTS_FILE_NAME, 0444, dir,
+			   &data->rate_requests);
+	debugfs_create_u64(DEBUGFS_RATE_COALESCED_FILE_NAME, 0444, dir,
+			   &data->rate_coalesced);
+	debugfs_create_file(DEBUGFS_GLIDE_FILE_NAME, 0644, dir, data,
+			    &debugfs_glide_ops);
+	debugfs_create_file(DEBUGFS_PRESET_FILE_NAME, 0644, dir, data,
+			    &debugfs_preset_ops);
+	debugfs_create_file(DEBUGFS_PRESTAGE_FILE_NAME, 0644, dir, data,
+			    &debugfs_prestage_ops);
+	debugfs_create_file(DEBUGFS_NVM_COMMIT_FILE_NAME, 0600, dir, data,
+			    &debugfs_nvm_commit_ops);
+	debugfs_create_u64(DEBUGFS_NVM_WRITES_FILE_NAME, 0444, dir,
+			   &data->nvm_writes);
+	debugfs_create_file(DEBUGFS_I2C_BIN_FILE_NAME, 0200, dir, data,
+			    &debugfs_i2c_bin_ops);
+	debugfs_create_file_size(DEBUGFS_REGS_FILE_NAME, 0444, dir, data,
+				 &debugfs_regs_ops, NUM_CONFIG_REGISTERS);
+
+	/* The decoded state is read without touching the bus */
+	debugfs_create_u16(DEBUGFS_DIVO_FILE_NAME, 0444, dir, &data->divo);
+	debugfs_create_u16(DEBUGFS_DIVNINT_FILE_NAME, 0444, dir,
+			   &data->divnint);
+	debugfs_create_u32(DEBUGFS_DIVNFRAC_FILE_NAME, 0444, dir,
+			   &data->divnfrac);
+	debugfs_create_u64(DEBUGFS_FVCO_FILE_NAME, 0444, dir, &data->fvco);
+	debugfs_create_u8(DEBUGFS_ICP_VALUE_FILE_NAME, 0444, dir,
+			  &data->icp_value);
+	idtxp_create_debugfs_xo(data, debugfs_create_dir(DEBUGFS_XO_DIR_NAME,
+							 dir));
+}
+
+/**
+ * idtxp_set_rate_policy() - Set the rate through the clk API with a policy.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The rate (in Hz).
+ * @policy:	IDTXP_RATE_AUTO, _SMALL or _LARGE.
+ *
+ * The change goes through clk_set_rate(), so the rate notifiers, the rate
+ * ranges and the exclusivity of the consumers all apply. The policy rides
+ * along as hint_rate, which only the set_rate of that very rate takes.
+ * The clk core skips set_rate for the rate already set, so a large change
+ * to it, a mere relock, is programmed directly.
+ *
+ * Return: 0 on success, -ERANGE if a small change was asked for a rate
+ * too far off, another negative errno otherwise.
+ */
+static int idtxp_set_rate_policy(struct clk_idtxp *data, unsigned long rate,
+				 enum idtxp_rate_policy policy)
+{
+	long rounded;
+	bool unchanged;
+	int err;
+
+	mutex_lock(&data->policy_lock);
+
+	rounded = clk_round_rate(data->hw.clk, rate);
+	if (rounded <= 0) {
+		err = rounded ? rounded : -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&data->lock);
+	unchanged = rounded == data->act_freq;
+	if (policy == IDTXP_RATE_SMALL &&
+	    !idtxp_is_small_change(data, rounded)) {
+		mutex_unlock(&data->lock);
+		err = -ERANGE;
+		goto out;
+	}
+	data->hint_rate = rounded;
+	data->hint_policy = policy;
+	data->hint_err = 0;
+	mutex_unlock(&data->lock);
+
+	if (unchanged) {
+		err = 0;
+		if (policy == IDTXP_RATE_LARGE)
+			err = idtxp_program_rate(data, rounded, policy);
+	} else {
+		err = clk_set_rate(data->hw.clk, rate);
+		if (!err && data->async_rate)
+			wait_for_completion(&data->rate_done);
+	}
+
+	mutex_lock(&data->lock);
+	if (!err)
+		err = data->hint_err;
+	data->hint_rate = 0;
+	mutex_unlock(&data->lock);
+out:
+	mutex_unlock(&data->policy_lock);
+
+	return err;
+}
+
+/**
+ * idtxp_change_rate() - Change the rate with an explicit policy.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @req:	The rate change.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_change_rate(struct clk_idtxp *data,
+			     const struct idtxp_rate_req *req)
+{
+	if (req->reserved || req->rate < data->min_freq ||
+	    req->rate > data->max_freq)
+		return -EINVAL;
+
+	switch (req->policy) {
+	case IDTXP_RATE_AUTO:
+	case IDTXP_RATE_SMALL:
+	case IDTXP_RATE_LARGE:
+		return idtxp_set_rate_policy(data, req->rate, req->policy);
+	case IDTXP_RATE_GLIDE:
+		return idtxp_glide_start(data, req->rate, req->slew);
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * idtxp_get_state() - Copy the decoded state of the device.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @state:	The state to fill in.
+ */
+static void idtxp_get_state(struct clk_idtxp *data, struct idtxp_state *state)
+{
+	const struct clk_xo_setting *xo = &data->xo;
+
+	memset(state, 0, sizeof(*state));
+
+	mutex_lock(&data->lock);
+	state->req_freq = data->req_freq;
+	state->act_freq = data->act_freq;
+	state->rate_num = data->rate_num;
+	state->rate_den = data->rate_den;
+	state->scaled_ppm = data->scaled_ppm;
+	state->fvco = data->fvco;
+	state->fxtal = data->fxtal;
+	state->pfd = data->solver.pfd;
+	state->divnfrac = data->divnfrac;
+	state->divo = data->divo;
+	state->divnint = data->divnint;
+	state->icp_value = data->icp_value;
+	state->icp_offset_en = data->icp_offst_en;
+	state->pll_mode = data->pll_mode;
+	state->locked = completion_done(&data->pll_locked) &&
+			!data->pll_lock_err;
+	state->glide_active = data->glide_active;
+	state->suspended = data->suspended;
+
+	state->xo.hsp_i2c_en = xo->hsp_i2c_en;
+	state->xo.cmos_en = xo->cmos_en;
+	state->xo.dblr_dis = xo->dblr_dis;
+	state->xo.vdd_def = xo->vdd_def;
+	state->xo.vcxo_dis = xo->vcxo_dis;
+	state->xo.vcxo_bw = xo->vcxo_bw;
+	state->xo.vcxo_gslope = xo->vcxo_gslope;
+	state->xo.vcxo_gexp = xo->vcxo_gexp;
+	state->xo.vcxo_gscale = xo->vcxo_gscale;
+	state->xo.oe_pol_en = xo->oe_pol_en;
+	state->xo.drv_type = xo->drv_type;
+	state->xo.gm = xo->gm;
+	state->xo.cap_x1 = xo->cap_x1;
+	state->xo.ampslice = xo->ampslice;
+	state->xo.bypass = xo->bypass;
+	state->xo.cap_x2 = xo->cap_x2;
+	state->xo.ot_dis = xo->ot_dis;
+	state->xo.ot_res = xo->ot_res;
+	mutex_unlock(&data->lock);
+}
+
+/**
+ * idtxp_run_batch() - Run the operations of a batch in order.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @ops:	The operations, their results are set for the ones run.
+ * @num:	The number of operations.
+ * @done:	Set to the number of operations run.
+ *
+ * Consecutive register writes are gathered into one atomic script. All
+ * the operations are checked before the first one is run.
+ *
+ * Return: 0 if all of them succeeded, the error of the failed one
+ * otherwise.
+ */
+static int idtxp_run_batch(struct clk_idtxp *data, struct idtxp_op *ops,
+			   unsigned int num, unsigned int *done)
+{
+	struct idtxp_script *script;
+	struct idtxp_state state;
+	unsigned int i, j;
+	int err = 0;
+
+	for (i = 0; i < num; i++) {
+		switch (ops[i].type) {
+		case IDTXP_OP_SET_RATE:
+			if (ops[i].rate.policy > IDTXP_RATE_GLIDE ||
+			    ops[i].rate.reserved)
+				return -EINVAL;
+			break;
+		case IDTXP_OP_WRITE_REG:
+			if (!regmap_check_range_table(data->regmap, ops[i].reg,
+						      &idtxp_writeable_table))
+				return -EINVAL;
+			break;
+		case IDTXP_OP_GET_STATE:
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	script = kzalloc(sizeof(*script), GFP_KERNEL);
+	if (!script)
+		return -ENOMEM;
+	script->atomic = true;
+
+	for (i = 0; i < num && !err; i = j) {
+		j = i + 1;
+
+		switch (ops[i].type) {
+		case IDTXP_OP_SET_RATE:
+			err = idtxp_change_rate(data, &ops[i].rate);
+			break;
+		case IDTXP_OP_WRITE_REG:
+			script->num = 0;
+			for (j = i; j < num && ops[j].type == IDTXP_OP_WRITE_REG;
+			     j++) {
+				script->writes[script->num].reg = ops[j].reg;
+				script->writes[script->num].val = ops[j].val;
+				script->num++;
+			}
+			err = idtxp_apply_script(data, script);
+			break;
+		case IDTXP_OP_GET_STATE:
+			idtxp_get_state(data, &state);
+			if (copy_to_user(u64_to_user_ptr(ops[i].state), &state,
+					 sizeof(state)))
+				err = -EFAULT;
+			break;
+		}
+
+		while (i < j)
+			ops[i++].result = err;
+	}
+	*done = i;
+
+	kfree(script);
+
+	return err;
+}
+
+static int idtxp_cdev_open(struct inode *inode, struct file *filp)
+{
+	struct clk_idtxp *data = container_of(filp->private_data,
+					      struct clk_idtxp, misc);
+	struct idtxp_reader *reader;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+	reader->cdev = data->cdev;
+	kref_get(&reader->cdev->kref);
+	init_waitqueue_head(&reader->wait);
+
+	spin_lock(&data->readers_lock);
+	list_add_tail(&reader->node, &data->readers);
+	spin_unlock(&data->readers_lock);
+
+	filp->private_data = reader;
+	return nonseekable_open(inode, filp);
+}
+
+static void idtxp_cdev_free(struct kref *kref)
+{
+	kfree(container_of(kref, struct idtxp_cdev, kref));
+}
+
+static int idtxp_cdev_release(struct inode *inode, struct file *filp)
+{
+	struct idtxp_reader *reader = filp->private_data;
+	struct idtxp_cdev *cdev = reader->cdev;
+	struct clk_idtxp *data;
+
+	down_read(&cdev->rwsem);
+	data = cdev->data;
+	if (data) {
+		spin_lock(&data->readers_lock);
+		list_del(&reader->node);
+		spin_unlock(&data->readers_lock);
+	}
+	up_read(&cdev->rwsem);
+
+	kfree(reader);
+	kref_put(&cdev->kref, idtxp_cdev_free);
+	return 0;
+}
+
+/**
+ * idtxp_cdev_alloc() - Allocate what the open files of a device share.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Return: 0 on success, -ENOMEM otherwise.
+ */
+static int idtxp_cdev_alloc(struct clk_idtxp *data)
+{
+	data->cdev = kzalloc(sizeof(*data->cdev), GFP_KERNEL);
+	if (!data->cdev)
+		return -ENOMEM;
+
+	kref_init(&data->cdev->kref);
+	init_rwsem(&data->cdev->rwsem);
+	data->cdev->data = data;
+
+	return 0;
+}
+
+/**
+ * idtxp_cdev_detach() - Detach the open files from a device being removed.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * misc_deregister() leaves the open files open, so they must not reach
+ * data once it is freed. Waits for the file operations using data, then
+ * wakes up the readers, which see the device is gone. Only the files of
+ * this device are waited for.
+ */
+static void idtxp_cdev_detach(struct clk_idtxp *data)
+{
+	struct idtxp_cdev *cdev = data->cdev;
+	struct idtxp_reader *reader, *next;
+
+	down_write(&cdev->rwsem);
+	WRITE_ONCE(cdev->data, NULL);
+	spin_lock(&data->readers_lock);
+	list_for_each_entry_safe(reader, next, &data->readers, node) {
+		list_del_init(&reader->node);
+		wake_up_interruptible(&reader->wait);
+	}
+	spin_unlock(&data->readers_lock);
+	up_write(&cdev->rwsem);
+
+	data->cdev = NULL;
+	kref_put(&cdev->kref, idtxp_cdev_free);
+}
+
+/**
+ * idtxp_pop_event() - Take the oldest event of an open file.
+ * @reader:	The open file.
+ * @event:	Set to the event.
+ *
+ * Return: 1 if there was an event, 0 if not, -ENODEV if the device is gone.
+ */
+static int idtxp_pop_event(struct idtxp_reader *reader,
+			   struct idtxp_event *event)
+{
+	struct clk_idtxp *data;
+	int found = -ENODEV;
+
+	down_read(&reader->cdev->rwsem);
+	data = reader->cdev->data;
+	if (data) {
+		spin_lock(&data->readers_lock);
+		found = reader->count ? 1 : 0;
+		if (found) {
+			*event = reader->events[reader->head];
+			reader->head = (reader->head + 1) %
+				       IDTXP_EVENT_QUEUE_LEN;
+			reader->count--;
+		}
+		spin_unlock(&data->readers_lock);
+	}
+	up_read(&reader->cdev->rwsem);
+
+	return found;
+}
+
+/**
+ * idtxp_cdev_read() - Read the pending events.
+ * @filp:		Open file to invoke ioctl method on.
+ * @user_buffer:	Buffer to read the struct idtxp_event records to.
+ * @count:		Size of the buffer.
+ * @ppos:		Offset within the file.
+ *
+ * Blocks until an event is pending, unless the file is non-blocking,
+ * then returns as many as are pending and fit. Reads end of file once the
+ * device is removed.
+ *
+ * Return: number of bytes read, negative errno otherwise.
+ */
+static ssize_t idtxp_cdev_read(struct file *filp, char __user *user_buffer,
+			       size_t count, loff_t *ppos)
+{
+	struct idtxp_reader *reader = filp->private_data;
+	struct idtxp_event event;
+	size_t read = 0;
+	int found, err;
+
+	if (count < sizeof(event))
 		return -EINVAL;
+
+	for (;;) {
+		found = idtxp_pop_event(reader, &event);
+		if (found)
+			break;
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		err = wait_event_interruptible(reader->wait,
+					       READ_ONCE(reader->count) ||
+					       !READ_ONCE(reader->cdev->data));
+		if (err)
+			return err;
 	}
+	if (found < 0)
+		return 0;
 
-	data->req_freq = rate;
+	do {
+		if (copy_to_user(user_buffer + read, &event, sizeof(event)))
+			return read ? read : -EFAULT;
+		read += sizeof(event);
+	} while (count - read >= sizeof(event) &&
+		 idtxp_pop_event(reader, &event) > 0);
 
-	if (div64_u64(abs(rate - data->act_freq) * 10000LL,
-				data->act_freq) < 5) 
-		return idtxp_small_frequency_change(data, rate);
-	else
-		return idtxp_large_frequency_change(data, rate);
+	return read;
 }
 
-static const struct clk_ops idtxp_clk_ops = {
-	.recalc_rate = idtxp_recalc_rate,
-	.round_rate = idtxp_round_rate,
-	.set_rate = idtxp_set_rate,
-};
+static __poll_t idtxp_cdev_poll(struct file *filp, poll_table *wait)
+{
+	struct idtxp_reader *reader = filp->private_data;
+
+	poll_wait(filp, &reader->wait, wait);
+
+	if (!READ_ONCE(reader->cdev->data))
+		return EPOLLHUP | EPOLLERR;
+	return READ_ONCE(reader->count) ? EPOLLIN | EPOLLRDNORM : 0;
+}
 
-static bool idtxp_regmap_is_volatile(struct device *dev, unsigned int reg)
+static long idtxp_cdev_do_ioctl(struct clk_idtxp *data, unsigned int cmd,
+				unsigned long arg)
 {
-	return false;
+	void __user *argp = (void __user *)arg;
+	struct idtxp_rate_req req;
+	struct idtxp_state state;
+	struct idtxp_batch batch;
+	struct idtxp_op *ops;
+	__s64 scaled_ppm;
+	__u32 rate;
+	int err;
+
+	switch (cmd) {
+	case IDTXP_IOC_SET_RATE:
+		if (copy_from_user(&req, argp, sizeof(req)))
+			return -EFAULT;
+		return idtxp_change_rate(data, &req);
+
+	case IDTXP_IOC_GET_STATE:
+		idtxp_get_state(data, &state);
+		if (copy_to_user(argp, &state, sizeof(state)))
+			return -EFAULT;
+		return 0;
+
+	case IDTXP_IOC_ADJFINE:
+		if (copy_from_user(&scaled_ppm, argp, sizeof(scaled_ppm)))
+			return -EFAULT;
+		if (scaled_ppm < LONG_MIN || scaled_ppm > LONG_MAX)
+			return -ERANGE;
+		return idtxp_adjfine(data, scaled_ppm);
+
+	case IDTXP_IOC_PRESTAGE:
+		if (copy_from_user(&rate, argp, sizeof(rate)))
+			return -EFAULT;
+		return idtxp_hint_rate(data, rate);
+
+	case IDTXP_IOC_BATCH:
+		if (copy_from_user(&batch, argp, sizeof(batch)))
+			return -EFAULT;
+		if (!batch.num || batch.num > IDTXP_BATCH_MAX)
+			return -EINVAL;
+
+		ops = memdup_user(u64_to_user_ptr(batch.ops),
+				  batch.num * sizeof(*ops));
+		if (IS_ERR(ops))
+			return PTR_ERR(ops);
+
+		batch.done = 0;
+		err = idtxp_run_batch(data, ops, batch.num, &batch.done);
+
+		if (copy_to_user(u64_to_user_ptr(batch.ops), ops,
+				 batch.num * sizeof(*ops)) ||
+		    copy_to_user(argp, &batch, sizeof(batch)))
+			err = -EFAULT;
+		kfree(ops);
+		return err;
+
+	default:
+		return -ENOTTY;
+	}
 }
 
-static bool idtxp_regmap_is_writeable(struct device *dev, unsigned int reg)
+static long idtxp_cdev_ioctl(struct file *filp, unsigned int cmd,
+			     unsigned long arg)
 {
-	return true;
+	struct idtxp_reader *reader = filp->private_data;
+	struct idtxp_cdev *cdev = reader->cdev;
+	long err = -ENODEV;
+
+	down_read(&cdev->rwsem);
+	if (cdev->data)
+		err = idtxp_cdev_do_ioctl(cdev->data, cmd, arg);
+	up_read(&cdev->rwsem);
+
+	return err;
 }
 
-static const struct regmap_config idtxp_regmap_config = {
-	.reg_bits = 8,
-	.val_bits = 8,
-	.cache_type = REGCACHE_RBTREE,
-	.max_register = 256,
-	.writeable_reg = idtxp_regmap_is_writeable,
-	.volatile_reg = idtxp_regmap_is_volatile,
+static const struct file_operations idtxp_cdev_ops = {
+	.owner = THIS_MODULE,
+	.open = idtxp_cdev_open,
+	.release = idtxp_cdev_release,
+	.read = idtxp_cdev_read,
+	.poll = idtxp_cdev_poll,
+	.unlocked_ioctl = idtxp_cdev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = no_llseek,
 };
 
 /**
- * idtxp_read_all_settings() - Read in registers and print to a buffer
- * @data:	The clock device structure that contains all the requested
+ * idtxp_init_data() - Initialise the locks and rate state of a device.
+ * @data: 	The clock device structure that contains all the requested
  * 		data for outputting frequency.
- * @buf:	The printed out buffer.
- * @count:	The size of the buffer.
- * 
+ */
+static void idtxp_init_data(struct clk_idtxp *data)
+{
+	mutex_init(&data->lock);
+	mutex_init(&data->policy_lock);
+	init_completion(&data->pll_locked);
+	complete_all(&data->pll_locked);
+	data->lock_est_ns = IDTXP_LOCK_EST_NS;
+	INIT_WORK(&data->rate_work, idtxp_rate_work);
+	spin_lock_init(&data->pending_lock);
+	init_completion(&data->rate_done);
+	complete_all(&data->rate_done);
+	hrtimer_init(&data->glide_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	data->glide_timer.function = idtxp_glide_timer;
+	INIT_WORK(&data->glide_work, idtxp_glide_work);
+	init_completion(&data->glide_done);
+	complete_all(&data->glide_done);
+	spin_lock_init(&data->readers_lock);
+	INIT_LIST_HEAD(&data->readers);
+	INIT_WORK(&data->debugfs_work, idtxp_create_debugfs);
+}
+
+/**
+ * idtxp_read_presets() - Read and solve the frequency-presets DT property.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * The property is optional.
+ *
  * Return: 0 on success, negative errno otherwise.
  */
-static int idtxp_read_all_settings(struct clk_idtxp *data,
-				   char *buf,
-				   int count)
+static int idtxp_read_presets(struct clk_idtxp *data)
 {
-	int i;
-	int err = 0;
-	u8 settings[NUM_CONFIG_REGISTERS];
-	char tmp[10];
+	struct device *dev = &data->i2c_client->dev;
+	unsigned int i;
+	int num, err;
 
-	err = regmap_bulk_read(data->regmap,
-			       0,
-			       settings,
-			       NUM_CONFIG_REGISTERS);
-	sprintf(buf, "     0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f\n");
-	if (!err) {
-		for (i = 0; i < NUM_CONFIG_REGISTERS; i++) {
-			if (i % 16 == 0) {
-				sprintf(tmp, "%02x  ", i);
-				strcat(buf, tmp);
-			}
-			sprintf(tmp, "%02x ", settings[i]);
-			strcat(buf, tmp);
-			if ((i + 1) % 16 == 0)
-				strcat(buf, "\n");
+	num = of_property_count_u32_elems(dev->of_node, "frequency-presets");
+	if (num <= 0)
+		return 0;
+
+	data->presets = devm_kcalloc(dev, num, sizeof(*data->presets),
+				     GFP_KERNEL);
+	if (!data->presets)
+		return -ENOMEM;
+
+	for (i = 0; i < num; i++) {
+		of_property_read_u32_index(dev->of_node, "frequency-presets",
+					   i, &data->presets[i].rate);
+		if (data->presets[i].rate < data->min_freq ||
+		    data->presets[i].rate > data->max_freq) {
+			dev_err(dev, "preset %u Hz is out of range\n",
+				data->presets[i].rate);
+			return -EINVAL;
 		}
 	}
-	strcat(buf, "\n");
-	return err;
+	data->num_presets = num;
+
+	err = idtxp_solve_presets(data);
+	if (err) {
+		dev_err(dev, "failed solving the presets (%i)\n", err);
+		return err;
+	}
+	dev_info(dev, "%u frequency presets\n", data->num_presets);
+
+	return 0;
 }
 
-static int debugfs_i2c_open(struct inode *inode, struct file *filp)
+/* Probe marks the device active before runtime PM is enabled */
+static void idtxp_pm_set_suspended(void *dev)
 {
-	filp->private_data = inode->i_private;
-	return 0;
+	pm_runtime_set_suspended(dev);
+}
+
+/* Consumers may queue rate_work for as long as the clk is registered */
+static void idtxp_cancel_rate_work(void *rate_work)
+{
+	cancel_work_sync(rate_work);
 }
 
 /**
- * debugfs_i2c_read() - Read in all the device registers.
- * @filp:		Open file to invoke ioctl method on.
- * @user_buffer:	Buffer to read data from.
- * @count:		Size of the buffer.
- * @ppos:		Offset within the file.
- * 
+ * idtxp_init_regs() - Bring the device registers to the DT settings.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @variant:	The device variant.
+ * @vdd_def:	Power supply voltage from DT, negative if not given.
+ *
+ * The regmap cache was filled by reading the register space once, see
+ * idtxp_regmap_config, so the readback here stays off the bus. The whole
+ * image is taken if there is a settings array to compare with it, and
+ * everything probe programs is staged against that image. Only the
+ * registers that differ are written, in a single commit, so a device left
+ * set up by a previous boot or module load sees no writes at all.
+ *
  * Return: 0 on success, negative errno otherwise.
  */
-static ssize_t debugfs_i2c_read(struct file *filp, char __user *user_buffer,
-				size_t count, loff_t *ppos)
+static int idtxp_init_regs(struct clk_idtxp *data,
+			   enum clk_idtxp_variant variant, int vdd_def)
 {
+	struct device *dev = &data->i2c_client->dev;
+	unsigned int reg;
 	int err;
-	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
-	char *buf = kzalloc(5000, GFP_KERNEL);
 
-	err = idtxp_read_all_settings(data, buf, 5000);
+	if (data->has_settings)
+		err = idtxp_read_image(data);
+	else
+		err = idtxp_get_defaults(data);
 	if (err) {
-		dev_err(&data->i2c_client->dev,
-			"error calling idtxp_read_all_settings (%i)\n", err);
-		return 0;
+		dev_err(dev, "failed reading the registers (%i)\n", err);
+		return err;
 	}
+	idtxp_nvm_snapshot(data);
 
-	err = simple_read_from_buffer(
-		user_buffer, count, ppos, buf, strlen(buf));
-	kfree(buf);
-	return err;
-}
+	if (data->has_settings)
+		idtxp_stage_regs(data, 0, data->settings,
+				 NUM_CONFIG_REGISTERS);
 
-/**
- * debugfs_i2c_write() - Write an value into register.
- * @filp:		Open file to invoke ioctl method on.
- * @user_buffer:	Buffer to read data from.
- * @count:		Size of the buffer.
- * @ppos:		Offset within the file.
- * 
- * Return: 0 on success, negative errno otherwise.
- */
-static ssize_t debugfs_i2c_write(struct file *filp, 
-		const char __user *user_buffer,	size_t count, loff_t *ppos)
-{
-	int err, written, i, num;
-	struct clk_idtxp *data = (struct clk_idtxp*)filp->private_data;
-	char *buf = kzalloc(10, GFP_KERNEL);
-	char *next_ptr;
-	u8 settings[2];
+	if (variant == idtxp_xo) {
+		idtxp_stage_reg(data, IDTXP_REG_HSPI2C_CMOS, 0x15);
+		idtxp_stage_reg(data, IDTXP_REG_VCXO, 0x2A);
+	}
 
-	written = simple_write_to_buffer(buf, 5000,
-		ppos, user_buffer, count);
+	idtxp_stage_hs_i2c(data);
 
-	dev_info(&data->i2c_client->dev, "echo: %s", buf);
-	
-	if (written > 10) {
-		dev_info(&data->i2c_client->dev, "written too much");
-		return written;
-	}
-
-	for (i = 0, num = 0, next_ptr = buf; i < count && num < 2; i++) {
-		if (buf[i] == ' ' || buf[i] == '\n') {
-			buf[i] = '\0';
-			err = kstrtou8(next_ptr, 16, settings + num);
-			if (err) {
-				dev_err(&data->i2c_client->dev, 
-					"parsing error");
-				return written;
-			}
-			next_ptr = buf + i + 1;
-			num++;
-		}
-	}
+	/* The image holds what the device will have once committed */
+	idtxp_decode_divs(data);
+	idtxp_decode_xo_settings(data);
+	if (vdd_def >= 0)
+		data->xo.vdd_def = vdd_def;
+
+	idtxp_calc_xo_settings(data);
+	idtxp_stage_xo_settings(data);
 
-	dev_info(&data->i2c_client->dev, 
-		 "addr: %u val: %u", 
-		 settings[0], 
-		 settings[1]);
+	/*
+	 * The variant defaults and the bus speed stage on top of each other,
+	 * so a register may end up back at the value read. Nvm_regs still
+	 * holds that readback.
+	 */
+	for_each_set_bit(reg, data->regs_dirty, NUM_CONFIG_REGISTERS)
+		if (!idtxp_reg_differs_from_nvm(data, reg))
+			__clear_bit(reg, data->regs_dirty);
 
-	err = regmap_write(data->regmap, settings[0], settings[1]);
+	err = idtxp_commit_regs(data);
 	if (err) {
-		dev_err(&data->i2c_client->dev, "error writing to register");
+		dev_err(dev, "failed writing the settings (%i)\n", err);
 		return err;
 	}
-	dev_info(&data->i2c_client->dev, "writing successful");
 
-	return written;
+	idtxp_update_pfd(data);
+	idtxp_update_rate(data);
+
+	return 0;
 }
 
-struct file_operations debugfs_i2c_ops = {
-	.owner = THIS_MODULE,
-	.open = debugfs_i2c_open,
-	.read = debugfs_i2c_read,
-	.write = debugfs_i2c_write,
-};
+/**
+ * idtxp_init_rate() - Program the initial output frequency.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @rate:	The clock-frequency from DT (in Hz).
+ *
+ * It is programmed before the clock is registered, as clk_set_rate()
+ * would hold the global prepare lock across the i2c writes and the PLL
+ * lock wait, serializing the probes of all the oscillators. A device
+ * already running at the rate is left alone.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_init_rate(struct clk_idtxp *data, u32 rate)
+{
+	struct clk_rate_request req = { .rate = rate };
+	int err;
+
+	data->req_freq = rate;
+	err = idtxp_determine_rate(&data->hw, &req);
+	if (err)
+		return err;
+
+	if (idtxp_rate_is_set(data, req.rate)) {
+		idtxp_update_rate(data);
+		return 0;
+	}
+
+	return idtxp_set_rate(&data->hw, req.rate, 0);
+}
 
 /**
  * idtxp_probe() - Main entry point for ccf driver.
@@ -1009,6 +4063,10 @@ static int idtxp_probe(struct i2c_client *client,
 	struct clk_idtxp *data;
 	struct clk_init_data init;
 	int err;
+	u32 tol_ppb;
+	u32 rate;
+	u8 dt_vdd;
+	int vdd_def = -1;
 	enum clk_idtxp_variant variant = id->driver_data;
 
 	data = devm_kzalloc(&client->dev, sizeof(*data), GFP_KERNEL);
@@ -1016,10 +4074,12 @@ static int idtxp_probe(struct i2c_client *client,
 		return -ENOMEM;
 
 	init.ops = &idtxp_clk_ops;
-	init.flags = 0;
+	/* recalc_rate is free and follows debugfs register writes */
+	init.flags = CLK_GET_RATE_NOCACHE;
 	init.num_parents = 0;
 	data->hw.init = &init;
 	data->i2c_client = client;
+	idtxp_init_data(data);
 
 	data->max_freq = IDTXP_MAX_FREQ;
 	data->min_freq = IDTXP_MIN_FREQ;
@@ -1038,6 +4098,16 @@ static int idtxp_probe(struct i2c_client *client,
 	dev_info(&client->dev, "registered, XO frequency %u Hz\n",
 			data->fxtal);
 
+	/* Optional policy for trading fractional accuracy for jitter */
+	data->solver.int_only = of_property_read_bool(client->dev.of_node,
+						      "integer-mode-only");
+	/* LOCK_PLL is only trusted as a status where the board says so */
+	data->lock_readback = of_property_read_bool(client->dev.of_node,
+						    "pll-lock-readback");
+	if (!of_property_read_u32(client->dev.of_node,
+				  "integer-mode-tolerance-ppb", &tol_ppb))
+		data->solver.int_tol = div_u64((u64)tol_ppb << 16, 1000);
+
 	err = of_property_read_u8_array(
 		client->dev.of_node, "settings", data->settings,
 		ARRAY_SIZE(data->settings));
@@ -1060,6 +4130,25 @@ static int idtxp_probe(struct i2c_client *client,
 			err);
 	}
 
+	/* Read the power supply voltage from device tree */
+	if (!of_property_read_u8(client->dev.of_node, "power-supply-voltage",
+				&dt_vdd)) {
+		if (dt_vdd < 3) {
+			dev_info(&client->dev,
+				 "vdd_def: %u",
+				 dt_vdd);
+			dev_info(&client->dev, 
+				 "registered, power supply voltage is %s\n",
+				 (dt_vdd == 0 ? "1.8V" :
+				 (dt_vdd == 1 ? "2.5V" : "3.3V")));
+		} else {
+			dev_info(&client->dev, 
+				 "The value for power supply voltage \
+				 must 0, 1 or 2\n");
+		}
+		vdd_def = dt_vdd;
+	}
+
 	data->regmap = devm_regmap_init_i2c(client, &idtxp_regmap_config);
 	if (IS_ERR(data->regmap)) {
 		dev_err(&client->dev, "failed to allocate register map\n");
@@ -1067,35 +4156,47 @@ static int idtxp_probe(struct i2c_client *client,
 	}
 
 	i2c_set_clientdata(client, data);
-	err = idtxp_get_defaults(data);
+	pm_runtime_set_active(&client->dev);
+	err = devm_add_action_or_reset(&client->dev, idtxp_pm_set_suspended,
+				       &client->dev);
 	if (err)
 		return err;
-	
-	/* Write in all the settings, if there is a setting array */
-	if (data->has_settings) {
-		err = idtxp_write_all_settings(data);
+
+	err = idtxp_init_regs(data, variant, vdd_def);
+	if (err)
+		return err;
+
+	/* The integer mode table only serves the integer mode policies */
+	if (data->solver.int_only || data->solver.int_tol) {
+		err = idtxp_build_int_rates(data);
 		if (err) {
 			dev_err(&client->dev,
-				"error writing all settings to chip (%i)\n",
+				"failed building integer mode table (%i)\n",
 				err);
 			return err;
 		}
-		dev_info(&client->dev, 
-			 "successfully wrote full settings array");
 	}
 
-	if (variant == idtxp_xo) {
-		regmap_write(data->regmap, IDTXP_REG_HSPI2C_CMOS, 0x15);
-		regmap_write(data->regmap, IDTXP_REG_VCXO, 0x2A);
+	err = idtxp_read_presets(data);
+	if (err)
+		return err;
+
+	/* Read the requested initial output frequency from device tree */
+	if (!of_property_read_u32(client->dev.of_node, "clock-frequency",
+				&rate)) {
+		err = idtxp_init_rate(data, rate);
+		if (err)
+			return err;
+		dev_info(&client->dev,
+			 "registered, current frequency %u Hz\n",
+			 data->act_freq);
 	}
 
-	/* Read all the values from hw */
-	err = idtxp_get_defaults(data);
-	if (err) {
-		dev_err(&client->dev,
-			"failed calling idtxp_get_defaults (%i)\n", err);
+	/* Added first, so it runs once devm has unregistered the clk */
+	err = devm_add_action_or_reset(&client->dev, idtxp_cancel_rate_work,
+				       &data->rate_work);
+	if (err)
 		return err;
-	}
 
 	err = devm_clk_hw_register(&client->dev, &data->hw);
 	if (err) {
@@ -1109,49 +4210,65 @@ static int idtxp_probe(struct i2c_client *client,
 		dev_err(&client->dev, "unable to add clk provider\n");
 		return err;
 	}
- 
-	/* Read the power supply voltage from device tree */
-	if (!of_property_read_u8(client->dev.of_node, "power-supply-voltage",
-				&data->xo.vdd_def)) {
-		if (data->xo.vdd_def >= 0 && data->xo.vdd_def < 3) {
-			dev_info(&client->dev,
-				 "vdd_def: %u",
-				 data->xo.vdd_def);
-			dev_info(&client->dev, 
-				 "registered, power supply voltage is %s\n",
-				 (data->xo.vdd_def == 0 ? "1.8V" :
-				 (data->xo.vdd_def == 1 ? "2.5V" : "3.3V")));
-		} else {
-			dev_info(&client->dev, 
-				 "The value for power supply voltage \
-				 must 0, 1 or 2\n");
-		}
-	}
 
-	idtxp_calc_xo_settings(data);
-	idtxp_write_xo_settings(data);
+	/* Later rate changes only queue the rate, once it is set up */
+	data->async_rate = of_property_read_bool(client->dev.of_node,
+						 "async-set-rate");
 
-	/* Read the requested initial output frequency from device tree */
-	if (!of_property_read_u32(client->dev.of_node, "clock-frequency",
-				&data->req_freq)) {
-		err = clk_set_rate(data->hw.clk, data->req_freq);
-		if (err) {
+	/* Control interface for userspace, /dev/idtxp-<i2c device> */
+	data->misc.minor = MISC_DYNAMIC_MINOR;
+	data->misc.name = devm_kasprintf(&client->dev, GFP_KERNEL, "idtxp-%s",
+					 dev_name(&client->dev));
+	if (!data->misc.name) {
+		of_clk_del_provider(client->dev.of_node);
+		return -ENOMEM;
+	}
+	data->misc.fops = &idtxp_cdev_ops;
+	data->misc.parent = &client->dev;
+	err = idtxp_cdev_alloc(data);
+	if (err) {
+		of_clk_del_provider(client->dev.of_node);
+		return err;
+	}
+	err = misc_register(&data->misc);
+	if (err) {
+		dev_err(&client->dev, "unable to register %s (%i)\n",
+			data->misc.name, err);
+		idtxp_cdev_detach(data);
+		of_clk_del_provider(client->dev.of_node);
+		return err;
+	}
+
+	/* Optionally disciplined through the PTP clock API, see adjfine */
+	if (of_property_read_bool(client->dev.of_node, "ptp-clock")) {
+		data->ptp_info = idtxp_ptp_info;
+		data->ptp = ptp_clock_register(&data->ptp_info, &client->dev);
+		if (IS_ERR(data->ptp)) {
+			err = PTR_ERR(data->ptp);
+			dev_err(&client->dev,
+				"unable to register PTP clock (%i)\n", err);
+			misc_deregister(&data->misc);
+			idtxp_cdev_detach(data);
 			of_clk_del_provider(client->dev.of_node);
 			return err;
 		}
-		dev_info(&client->dev,
-			 "registered, current frequency %u Hz\n",
-			 data->act_freq);
 	}
 
+	/* Idle, only the register image is kept, see idtxp_restore() */
+	pm_runtime_set_autosuspend_delay(&client->dev, IDTXP_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&client->dev);
+	err = devm_pm_runtime_enable(&client->dev);
+	if (err) {
+		if (data->ptp)
+			ptp_clock_unregister(data->ptp);
+		misc_deregister(&data->misc);
+		idtxp_cdev_detach(data);
+		of_clk_del_provider(client->dev.of_node);
+		return err;
+	}
 
-	/* Create the debugfs for driver test */
-	data->debugfs_root_dir = debugfs_create_dir(DEBUGFS_ROOT_DIR_NAME,
-			 			    NULL);
-	data->debugfs_i2c_file = debugfs_create_file(DEBUGFS_I2C_FILE_NAME,
-	 					     0644,
-						     data->debugfs_root_dir,
-						     data, &debugfs_i2c_ops);
+	/* Create the debugfs for driver test, off the probe path */
+	schedule_work(&data->debugfs_work);
 
 	return 0;
 }
@@ -1161,11 +4278,110 @@ static int idtxp_remove(struct i2c_client *client)
 	struct clk_idtxp *data = 
 		(struct clk_idtxp*)i2c_get_clientdata(client);
 		
+	if (data->ptp)
+		ptp_clock_unregister(data->ptp);
+	misc_deregister(&data->misc);
+	idtxp_cdev_detach(data);
 	of_clk_del_provider(client->dev.of_node);
+	cancel_work_sync(&data->debugfs_work);
 	debugfs_remove_recursive(data->debugfs_root_dir);
+	idtxp_glide_stop(data);
+	return 0;
+}
+
+/**
+ * idtxp_quiesce() - Stop the register accesses before the device is down.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ *
+ * Later rate changes are staged in the register image and reach the
+ * device in idtxp_restore().
+ */
+static void idtxp_quiesce(struct clk_idtxp *data)
+{
+	mutex_lock(&data->lock);
+	regcache_cache_only(data->regmap, true);
+	data->suspended = true;
+	mutex_unlock(&data->lock);
+}
+
+/**
+ * idtxp_restore() - Bring the device back to the register image.
+ * @data: 	The clock device structure that contains all the requested
+ * 		data for outputting frequency.
+ * @power_lost:	The device may have reloaded its registers from NVM.
+ *
+ * After a power loss only the registers that differ from the NVM
+ * contents are written, as coalesced block writes, and the PLL relocks
+ * to them. If NVM already holds the image nothing is written at all.
+ * Otherwise only the changes staged while suspended are written.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+static int idtxp_restore(struct clk_idtxp *data, bool power_lost)
+{
+	unsigned int reg;
+	int err = 0;
+
+	mutex_lock(&data->lock);
+
+	regcache_cache_only(data->regmap, false);
+	data->suspended = false;
+
+	if (power_lost)
+		for_each_set_bit(reg, data->regs_valid, NUM_CONFIG_REGISTERS)
+			if (idtxp_reg_differs_from_nvm(data, reg))
+				__set_bit(reg, data->regs_dirty);
+
+	if (bitmap_empty(data->regs_dirty, NUM_CONFIG_REGISTERS))
+		goto out;
+
+	err = idtxp_commit_regs(data);
+	if (!err)
+		err = idtxp_relock(data);
+out:
+	mutex_unlock(&data->lock);
+
+	if (err)
+		dev_err(&data->i2c_client->dev,
+			"failed restoring the registers (%i)\n", err);
+
+	return err;
+}
+
+static int __maybe_unused idtxp_suspend(struct device *dev)
+{
+	struct clk_idtxp *data = dev_get_drvdata(dev);
+
+	idtxp_glide_stop(data);
+	flush_work(&data->rate_work);
+	idtxp_quiesce(data);
+
+	return 0;
+}
+
+static int __maybe_unused idtxp_resume(struct device *dev)
+{
+	return idtxp_restore(dev_get_drvdata(dev), true);
+}
+
+static int __maybe_unused idtxp_runtime_suspend(struct device *dev)
+{
+	idtxp_quiesce(dev_get_drvdata(dev));
+
 	return 0;
 }
 
+static int __maybe_unused idtxp_runtime_resume(struct device *dev)
+{
+	return idtxp_restore(dev_get_drvdata(dev), false);
+}
+
+static const struct dev_pm_ops idtxp_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(idtxp_suspend, idtxp_resume)
+	SET_RUNTIME_PM_OPS(idtxp_runtime_suspend, idtxp_runtime_resume, NULL)
+};
+
 static const struct i2c_device_id idtxp_id[] = {
 	{ "idtxp_pro_xo", idtxp_xo },
 	{ }
@@ -1182,12 +4398,38 @@ static struct i2c_driver idtxp_driver = {
 	.driver = {
 		.name = "idtxp",
 		.of_match_table = clk_idtxp_of_match,
+		.pm = &idtxp_pm_ops,
+		/* the oscillators on different buses probe in parallel */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe		= idtxp_probe,
 	.remove		= idtxp_remove,
 	.id_table	= idtxp_id,
 };
-module_i2c_driver(idtxp_driver);
+static int __init idtxp_init(void)
+{
+	int err;
+
+	idtxp_debugfs_root = debugfs_create_dir(DEBUGFS_ROOT_DIR_NAME, NULL);
+
+	err = i2c_add_driver(&idtxp_driver);
+	if (err)
+		debugfs_remove_recursive(idtxp_debugfs_root);
+
+	return err;
+}
+module_init(idtxp_init);
+
+static void __exit idtxp_exit(void)
+{
+	i2c_del_driver(&idtxp_driver);
+	debugfs_remove_recursive(idtxp_debugfs_root);
+}
+module_exit(idtxp_exit);
+
+#if IS_ENABLED(CONFIG_CLK_IDTXP_KUNIT_TEST)
+#include "clk_idtxp_test.c"
+#endif
 
 MODULE_AUTHOR("");
 MODULE_DESCRIPTION("IDT XP family driver");
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-2.0
+/* clk_idtxp_bench.c - Userspace benchmark of the xp family divider solver.
+ *
+ * Copyright (C) 2018, Integrated Device Technology, Inc. <@idt.com>
+ *
+ * Sweeps every output frequency from IDTXP_MIN_FREQ to IDTXP_MAX_FREQ in
+ * steps of [step_hz] (1 kHz by default) for each supported crystal, and
+ * reports the mean time per solve, the worst single solve and the worst
+ * error, once for the fractional solver and once for integer mode only.
+ * Build against the same clk_idtxp_core.c as the module:
+ *
+ *   cc -O2 -o clk_idtxp_bench clk_idtxp_bench.c clk_idtxp_core.c
+ *   ./clk_idtxp_bench [step_hz]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "clk_idtxp_core.h"
+
+static const u32 bench_fxtals[] = { 50000000, 114285000, 156250000 };
+
+static u64 bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * bench_sweep() - Solve the whole output range once.
+ * @solver:	The solver state.
+ * @step:	Frequency step (in Hz).
+ *
+ * The sweep runs twice, first timing each solve on its own for the worst
+ * case, then the whole loop at once for a mean free of timer overhead.
+ */
+static void bench_sweep(const struct idtxp_solver *solver, u32 step)
+{
+	struct idtxp_divs divs;
+	u64 fout, t0, t, worst = 0, worst_fout = 0, total, solves = 0;
+	u64 fails = 0;
+	s64 ppm, worst_ppm = 0;
+	volatile int sink = 0;
+
+	for (fout = IDTXP_MIN_FREQ; fout <= IDTXP_MAX_FREQ; fout += step) {
+		t0 = bench_now_ns();
+		if (idtxp_find_divs(solver, fout, &divs)) {
+			fails++;
+			continue;
+		}
+		t = bench_now_ns() - t0;
+		if (t > worst) {
+			worst = t;
+			worst_fout = fout;
+		}
+		ppm = abs(divs.scaled_ppm);
+		if (ppm > worst_ppm)
+			worst_ppm = ppm;
+		solves++;
+	}
+
+	t0 = bench_now_ns();
+	for (fout = IDTXP_MIN_FREQ; fout <= IDTXP_MAX_FREQ; fout += step)
+		sink += idtxp_find_divs(solver, fout, &divs);
+	total = bench_now_ns() - t0;
+
+	printf("  %-10s %9" PRIu64 " solves %6" PRIu64 " failed "
+	       "%7.1f ns/solve  worst %6" PRIu64 " ns at %10" PRIu64 " Hz  "
+	       "worst error %.6f ppm\n",
+	       solver->int_only ? "integer" : "fractional", solves, fails,
+	       (double)total / (solves + fails), worst, worst_fout,
+	       worst_ppm / 65536.0);
+}
+
+int main(int argc, char **argv)
+{
+	struct clk_xo_setting xo = { 0 };
+	struct idtxp_solver solver = { 0 };
+	u32 step = 1000;
+	unsigned int i;
+
+	if (argc > 1)
+		step = strtoul(argv[1], NULL, 0);
+	if (!step) {
+		fprintf(stderr, "usage: %s [step_hz]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(bench_fxtals) / sizeof(bench_fxtals[0]); i++) {
+		if (idtxp_xo_settings(bench_fxtals[i], &xo))
+			return 1;
+		idtxp_solver_set_pfd(&solver, bench_fxtals[i], xo.dblr_dis);
+
+		solver.int_rates = malloc(idtxp_int_rates_max(&solver) *
+					  sizeof(*solver.int_rates));
+		if (!solver.int_rates)
+			return 1;
+		solver.num_int_rates = idtxp_int_rates_fill(&solver,
+							    IDTXP_MIN_FREQ,
+							    IDTXP_MAX_FREQ,
+							    solver.int_rates);
+
+		printf("fxtal %u Hz, pfd %u Hz, %u integer mode rates\n",
+		       bench_fxtals[i], solver.pfd, solver.num_int_rates);
+
+		solver.int_only = false;
+		bench_sweep(&solver, step);
+		solver.int_only = true;
+		bench_sweep(&solver, step);
+
+		free(solver.int_rates);
+	}
+
+	return 0;
+}
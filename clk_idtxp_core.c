@@ -0,0 +1,425 @@
+// SPDX-License-Identifier: GPL-2.0
+/* clk_idtxp_core.c - Divider and XO math of the xp family.
+ *
+ * Copyright (C) 2018, Integrated Device Technology, Inc. <@idt.com>
+ *
+ * Linked into the module next to clk_idtxp.c,
+ *
+ *   obj-$(CONFIG_CLK_IDTXP) += clk-idtxp.o
+ *   clk-idtxp-y := clk_idtxp.o clk_idtxp_core.o
+ *
+ * and built for the host with
+ *
+ *   cc -O2 -c clk_idtxp_core.c
+ *
+ * for clk_idtxp_bench.c, so it may only use what clk_idtxp_core.h shims.
+ */
+
+#ifdef __KERNEL__
+#include <linux/errno.h>
+#include <linux/gcd.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/sort.h>
+#endif
+
+#include "clk_idtxp_core.h"
+
+/**
+ * idtxp_solver_set_pfd() - Set the phase detector frequency.
+ * @solver:	The solver state.
+ * @fxtal:	Factory xtal frequency.
+ * @dblr_dis:	XO doubler disable.
+ *
+ * Must be called again whenever fxtal or the doubler changes, and the
+ * integer mode table rebuilt after it.
+ */
+void idtxp_solver_set_pfd(struct idtxp_solver *solver, u32 fxtal,
+			  bool dblr_dis)
+{
+	solver->pfd = fxtal * (dblr_dis ? 1 : 2);
+	solver->pfd_recip = solver->pfd ? div64_u64(U64_MAX, solver->pfd) : 0;
+}
+
+/**
+ * idtxp_div_pfd() - Divide by the phase detector frequency.
+ * @solver:	The solver state holding pfd and pfd_recip.
+ * @x:		Dividend, below 2^63.
+ * @rem:	Remainder of the division.
+ *
+ * The estimate from the reciprocal is low by at most one, so a single
+ * correction step gives the exact quotient without a 64-bit division.
+ *
+ * Return: x / pfd.
+ */
+static u64 idtxp_div_pfd(const struct idtxp_solver *solver, u64 x, u64 *rem)
+{
+	u64 q = mul_u64_u64_shr(x, solver->pfd_recip, 64);
+
+	*rem = x - q * solver->pfd;
+	if (*rem >= solver->pfd) {
+		q++;
+		*rem -= solver->pfd;
+	}
+	return q;
+}
+
+/**
+ * idtxp_scaled_ppm() - Relative frequency error in scaled ppm.
+ * @diff:	Frequency error.
+ * @ref:	Reference frequency, in the same units as @diff.
+ *
+ * Return: diff / ref in ppm with a 16-bit binary fractional field.
+ */
+s64 idtxp_scaled_ppm(s64 diff, u64 ref)
+{
+	u64 ppm = mul_u64_u64_div_u64(abs(diff), 1000000ULL << 16, ref);
+
+	return diff < 0 ? -(s64)ppm : (s64)ppm;
+}
+
+/**
+ * idtxp_divn_total() - Feedback divider as a 24-bit fixed point value.
+ * @divnint:	int component of feedback divider, as in the registers
+ * @divnfrac:	24-bit signed fractional component of feedback divider
+ *
+ * Return: (DIVN_INT + DIVN_FRAC / 2^24) * 2^24.
+ */
+u64 idtxp_divn_total(u16 divnint, u32 divnfrac)
+{
+	u64 total = ((u64)divnint << DIVN_FRAC_BITS) + divnfrac;
+
+	if (divnfrac & BIT(DIVN_FRAC_BITS - 1))
+		total -= BIT_ULL(DIVN_FRAC_BITS);
+	return total;
+}
+
+/**
+ * idtxp_divs_rate() - Output frequency produced by a set of dividers.
+ * @solver:	The solver state holding pfd.
+ * @divs:	The dividers.
+ *
+ * Return: the output frequency rounded to the nearest Hz.
+ */
+unsigned long idtxp_divs_rate(const struct idtxp_solver *solver,
+			      const struct idtxp_divs *divs)
+{
+	u64 den = (u64)divs->divo << DIVN_FRAC_BITS;
+	u64 num = solver->pfd * idtxp_divn_total(divs->divnint, divs->divnfrac);
+
+	return div64_u64(num + den / 2, den);
+}
+
+/**
+ * idtxp_solve_frac() - Find the feedback divider for a given DIVO.
+ * @solver:	The solver state, only pfd and pfd_recip are used.
+ * @fout:	The requested output frequency (in Hz).
+ * @divo:	The output divider to use.
+ * @divs:	The solved dividers.
+ *
+ * Keeping DIVO lets the output move without a PLL relock.
+ *
+ * Return: 0 on success, -ERANGE if the VCO or DIVN_INT is out of range.
+ */
+int idtxp_solve_frac(const struct idtxp_solver *solver, u32 fout, u16 divo,
+		     struct idtxp_divs *divs)
+{
+	u32 pfd = solver->pfd;
+	u64 target, total, rem;
+	s64 diff;
+
+	if (!pfd)
+		return -EINVAL;
+
+	divs->fvco = (u64)fout * divo;
+	if (divs->fvco < FVCO_MIN || divs->fvco > FVCO_MAX)
+		return -ERANGE;
+
+	/*
+	 * FBFrac bits = INT(0.5 + FBFrac * 2 ^ 24)
+	 *
+	 * The fraction is signed: FBFrac >= 0.5 is written as FBInt + 1
+	 * with the same fraction bits, which the PLL reads as negative.
+	 */
+	target = divs->fvco << DIVN_FRAC_BITS;
+	total = idtxp_div_pfd(solver, target, &rem);
+	if (rem >= pfd - rem) {
+		total++;
+		diff = pfd - rem;
+	} else {
+		diff = -(s64)rem;
+	}
+
+	divs->divo = divo;
+	divs->divnint = total >> DIVN_FRAC_BITS;
+	divs->divnfrac = total & GENMASK(DIVN_FRAC_BITS - 1, 0);
+	if (divs->divnfrac & BIT(DIVN_FRAC_BITS - 1))
+		divs->divnint++;
+	if (divs->divnint < DIVN_MIN || divs->divnint > DIVN_MAX)
+		return -ERANGE;
+
+	/* diff and target are both in units of 2^-24 Hz at the VCO */
+	divs->scaled_ppm = idtxp_scaled_ppm(diff, target);
+
+	return 0;
+}
+
+/**
+ * idtxp_solve_divs() - Find the best dividers for an output frequency.
+ * @solver:	The solver state, only pfd and pfd_recip are used.
+ * @fout:	The requested output frequency (in Hz).
+ * @divs:	The solved dividers.
+ *
+ * Fout = Fpfd * (DIVN_INT + DIVN_FRAC / 2^24) / DIVO
+ *
+ * An integer solution needs Fout * DIVO to be a multiple of Fpfd, that is
+ * DIVO a multiple of Fpfd / gcd(Fout, Fpfd). An exact fractional solution
+ * needs Fout * DIVO * 2^24 to be one, which drops the powers of two from
+ * that step. The lowest DIVO in the VCO range satisfying either is taken
+ * directly; failing both, the lowest DIVO with a rounded fraction is used.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+int idtxp_solve_divs(const struct idtxp_solver *solver, u32 fout,
+		     struct idtxp_divs *divs)
+{
+	u32 pfd = solver->pfd;
+	u32 divo, step;
+	u64 lo, hi;
+
+	if (!fout || !pfd)
+		return -EINVAL;
+
+	lo = max_t(u64, DIVO_MIN, DIV_ROUND_UP_ULL(FVCO_MIN, fout));
+	hi = min_t(u64, DIVO_MAX, div_u64(FVCO_MAX, fout));
+	if (lo > hi)
+		return -ERANGE;
+
+	step = pfd / gcd(fout, pfd);
+	divo = roundup((u32)lo, step);
+	if (divo > hi) {
+		step >>= min_t(unsigned int, __ffs(step), DIVN_FRAC_BITS);
+		divo = roundup((u32)lo, step);
+		if (divo > hi)
+			divo = lo;
+	}
+
+	return idtxp_solve_frac(solver, fout, divo, divs);
+}
+
+static int idtxp_int_rate_cmp(const void *a, const void *b)
+{
+	const struct idtxp_int_rate *x = a, *y = b;
+
+	if (x->rate != y->rate)
+		return x->rate < y->rate ? -1 : 1;
+	return x->divo - y->divo;
+}
+
+/**
+ * idtxp_int_rates_max() - Size of the integer mode table before pruning.
+ * @solver:	The solver state, only pfd is used.
+ *
+ * Return: the number of entries idtxp_int_rates_fill() may need, 0 if no
+ * DIVN_INT keeps the VCO in range.
+ */
+unsigned int idtxp_int_rates_max(const struct idtxp_solver *solver)
+{
+	u32 nmin, nmax;
+
+	if (!solver->pfd)
+		return 0;
+
+	nmin = max_t(u64, DIVN_MIN, DIV_ROUND_UP_ULL(FVCO_MIN, solver->pfd));
+	nmax = min_t(u64, DIVN_MAX, div_u64(FVCO_MAX, solver->pfd));
+	if (nmin > nmax)
+		return 0;
+
+	return (nmax - nmin + 1) * (DIVO_MAX - DIVO_MIN + 1);
+}
+
+/**
+ * idtxp_int_rates_fill() - Fill the table of integer mode frequencies.
+ * @solver:	The solver state, only pfd is used.
+ * @min_freq:	Lowest output frequency to include.
+ * @max_freq:	Highest output frequency to include.
+ * @tbl:	Room for idtxp_int_rates_max() entries.
+ *
+ * Every DIVN_INT keeping the VCO in range is paired with every DIVO giving
+ * an output between @min_freq and @max_freq. Where several pairs round to
+ * the same rate only the lowest DIVO is kept.
+ *
+ * Return: the number of entries, sorted by rate.
+ */
+unsigned int idtxp_int_rates_fill(const struct idtxp_solver *solver,
+				  u64 min_freq, u64 max_freq,
+				  struct idtxp_int_rate *tbl)
+{
+	u32 pfd = solver->pfd;
+	u32 divo, n, nmin, nmax, i, count = 0;
+	u64 fvco, rate;
+
+	if (!idtxp_int_rates_max(solver))
+		return 0;
+
+	nmin = max_t(u64, DIVN_MIN, DIV_ROUND_UP_ULL(FVCO_MIN, pfd));
+	nmax = min_t(u64, DIVN_MAX, div_u64(FVCO_MAX, pfd));
+
+	for (n = nmin; n <= nmax; n++) {
+		fvco = (u64)n * pfd;
+		for (divo = DIVO_MIN; divo <= DIVO_MAX; divo++) {
+			rate = div_u64(fvco + divo / 2, divo);
+			if (rate < min_freq || rate > max_freq)
+				continue;
+			tbl[count].rate = rate;
+			tbl[count].divo = divo;
+			tbl[count].divnint = n;
+			count++;
+		}
+	}
+
+	sort(tbl, count, sizeof(*tbl), idtxp_int_rate_cmp, NULL);
+	for (i = 0, n = 0; i < count; i++)
+		if (!n || tbl[i].rate != tbl[n - 1].rate)
+			tbl[n++] = tbl[i];
+
+	return n;
+}
+
+/**
+ * idtxp_solve_int_divs() - Find the closest integer mode dividers.
+ * @solver:	The solver state, only pfd and int_rates are used.
+ * @fout:	The requested output frequency (in Hz).
+ * @divs:	The solved dividers, divnfrac is always 0.
+ *
+ * Binary search of int_rates for the entries on either side of @fout.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+int idtxp_solve_int_divs(const struct idtxp_solver *solver, u32 fout,
+			 struct idtxp_divs *divs)
+{
+	const struct idtxp_int_rate *best;
+	unsigned int lo = 0, hi = solver->num_int_rates, mid;
+	u64 fvco;
+
+	if (!fout || !hi)
+		return -ERANGE;
+
+	/* First entry at or above fout */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (solver->int_rates[mid].rate < fout)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == solver->num_int_rates)
+		best = &solver->int_rates[lo - 1];
+	else if (lo && fout - solver->int_rates[lo - 1].rate <
+		       solver->int_rates[lo].rate - fout)
+		best = &solver->int_rates[lo - 1];
+	else
+		best = &solver->int_rates[lo];
+
+	fvco = (u64)fout * best->divo;
+	divs->divo = best->divo;
+	divs->divnint = best->divnint;
+	divs->divnfrac = 0;
+	divs->fvco = (u64)best->divnint * solver->pfd;
+	divs->scaled_ppm = idtxp_scaled_ppm(divs->fvco - fvco, fvco);
+
+	return 0;
+}
+
+/**
+ * idtxp_find_divs() - Solve the dividers following the rate policy.
+ * @solver:	The solver state.
+ * @fout:	The requested output frequency (in Hz).
+ * @divs:	The solved dividers.
+ *
+ * The integer mode solution replaces the fractional one if int_only is set
+ * or its error is within int_tol.
+ *
+ * Return: 0 on success, negative errno otherwise.
+ */
+int idtxp_find_divs(const struct idtxp_solver *solver, u32 fout,
+		    struct idtxp_divs *divs)
+{
+	int err;
+	struct idtxp_divs int_divs;
+
+	if (!solver->int_only) {
+		err = idtxp_solve_divs(solver, fout, divs);
+		if (err || !divs->divnfrac || !solver->int_tol)
+			return err;
+	}
+
+	err = idtxp_solve_int_divs(solver, fout, &int_divs);
+	if (err)
+		return solver->int_only ? err : 0;
+
+	if (solver->int_only || abs(int_divs.scaled_ppm) <= solver->int_tol)
+		*divs = int_divs;
+
+	return 0;
+}
+
+/**
+ * idtxp_charge_pump() - Charge pump value for a VCO frequency.
+ * @fvco:	VCO frequency (in Hz).
+ *
+ * Return: the ICP_VALUE field.
+ */
+u8 idtxp_charge_pump(u64 fvco)
+{
+	if (fvco < 7000000000LL)
+		return 5;
+	else if (fvco < 7400000000LL)
+		return 4;
+	else if (fvco < 7800000000LL)
+		return 3;
+	else
+		return 2;
+}
+
+/**
+ * idtxp_xo_settings() - XO settings for a factory xtal frequency.
+ * @fxtal:	Factory xtal frequency (in Hz).
+ * @xo:		The settings, only the XO and doubler fields are changed.
+ *
+ * Return: 0 on success, -EINVAL if @fxtal is not supported.
+ */
+int idtxp_xo_settings(u32 fxtal, struct clk_xo_setting *xo)
+{
+	if (40000000 <= fxtal && fxtal <= 80000000) {
+		xo->dblr_dis = 0x0;
+		xo->gm = 0x2;
+		xo->cap_x1 = 0x3C;
+		xo->ampslice = 0x1;
+		xo->cap_x2 = 0x2;
+		xo->ot_dis = 0x1;
+		xo->ot_res = 0x0;
+	} else if (100000000 <= fxtal && fxtal < 140000000) {
+		xo->dblr_dis = 0x1;
+		xo->gm = 0x2;
+		xo->cap_x1 = 0x15;
+		xo->ampslice = 0x0C;
+		xo->cap_x2 = 0x5;
+		xo->ot_dis = 0x0;
+		xo->ot_res = 0x5;
+	} else if (140000000 <= fxtal && fxtal <= 166000000) {
+		xo->dblr_dis = 0x1;
+		xo->gm = 0x3;
+		xo->cap_x1 = 0x15;
+		xo->ampslice = 0x0C;
+		xo->cap_x2 = 0x5;
+		xo->ot_dis = 0x0;
+		xo->ot_res = 0x3;
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* clk_idtxp_core.h - Divider and XO math of the xp family.
+ *
+ * Copyright (C) 2018, Integrated Device Technology, Inc. <@idt.com>
+ *
+ * Nothing in here touches the device, so clk_idtxp_core.c builds both
+ * into the module and as a plain userspace library for clk_idtxp_bench.c.
+ * Outside the kernel the few helpers it needs are provided below.
+ */
+
+#ifndef __CLK_IDTXP_CORE_H
+#define __CLK_IDTXP_CORE_H
+
+#ifdef __KERNEL__
+#include <linux/bits.h>
+#include <linux/types.h>
+#else
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+
+#define BIT(nr)			(1UL << (nr))
+#define BIT_ULL(nr)		(1ULL << (nr))
+#define GENMASK(h, l)		((~0ULL << (l)) & (~0ULL >> (63 - (h))))
+#define U64_MAX			UINT64_MAX
+
+#define min_t(type, x, y)	((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+#define max_t(type, x, y)	((type)(x) > (type)(y) ? (type)(x) : (type)(y))
+#define roundup(x, y)		((((x) + (y) - 1) / (y)) * (y))
+#define DIV_ROUND_UP_ULL(x, d)	(((x) + (d) - 1) / (d))
+#define abs(x)			llabs(x)
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 mul_u64_u64_shr(u64 a, u64 b, unsigned int shift)
+{
+	return (u64)(((unsigned __int128)a * b) >> shift);
+}
+
+static inline u64 mul_u64_u64_div_u64(u64 a, u64 b, u64 c)
+{
+	return (u64)((unsigned __int128)a * b / c);
+}
+
+static inline unsigned long __ffs(unsigned long word)
+{
+	return __builtin_ctzl(word);
+}
+
+static inline unsigned long gcd(unsigned long a, unsigned long b)
+{
+	unsigned long r;
+
+	while (b) {
+		r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+static inline void sort(void *base, size_t num, size_t size,
+			int (*cmp)(const void *, const void *), void *swap)
+{
+	(void)swap;
+	qsort(base, num, size, cmp);
+}
+#endif /* __KERNEL__ */
+
+/* Limits */
+#define DIVO_MIN    		4
+#define DIVO_MAX    		511
+
+#define DIVN_MIN    		41
+#define DIVN_MAX   		216
+#define DIVN_FRAC_BITS		24
+
+#define FVCO_MIN    		6860000000LL
+#define FVCO_MAX    		8650000000LL
+
+#define IDTXP_MIN_FREQ          16000000LL
+#define IDTXP_MAX_FREQ          2100000000LL
+#define IDTXP_HCSL_MAX_FREQ     725000000LL
+
+/**
+ * @hsp_i2c_en:		high speed i2c enable
+ * @cmos_en:		cmos output enable
+ * @dblr_dis:		XO frequency doubler disable
+ * @vdd_def:		power supply voltage
+ * @vcxo_dis:		vcxo disabler
+ * @vcxo_bw:		vcxo modulation bandwidth
+ * @vcxo_gslope:	vcxo gain slope
+ * @vcxo_gexp:		vcxo gain expoentially
+ * @vcxo_gscale:	vcxo gain scale
+ * @oe_pol_en:		output enable polarity
+ * @drv_type:		output logic type
+ * @gm:			XO amplifier gm overtone
+ * @cap_x1:		XO load capacitance trim value, x1 pin
+ * @ampslice:		XO amplifier slice
+ * @bypass:		bypass the XO oscillator
+ * @cap_x2:		XO load capacitance trim value, x2 pin
+ * @ot_dis:		overtone operation disable
+ * @ot_res:		overtone filter resistor value
+ */
+struct clk_xo_setting {
+	bool hsp_i2c_en;
+	bool cmos_en;
+	bool dblr_dis;
+	u8 vdd_def;
+	bool vcxo_dis;
+	u8 vcxo_bw;
+	bool vcxo_gslope;
+	u8 vcxo_gexp;
+	u8 vcxo_gscale;
+	bool oe_pol_en;
+	u8 drv_type;
+	u8 gm;
+	u8 cap_x1;
+	u8 ampslice;
+	bool bypass;
+	u8 cap_x2;
+	bool ot_dis;
+	u8 ot_res;
+};
+
+/**
+ * struct idtxp_divs - Divider values solved for one output frequency.
+ * @divo:		output clock divider
+ * @divnint:		int component of feedback divider, as written to the
+ *			registers (already carrying a negative fraction)
+ * @divnfrac:		24-bit fractional component of feedback divider
+ * @fvco:		VCO frequency requested from the dividers (in Hz)
+ * @scaled_ppm:		output frequency error in ppm with a 16-bit binary
+ *			fractional field, positive when the output is fast
+ */
+struct idtxp_divs {
+	u16 divo;
+	u16 divnint;
+	u32 divnfrac;
+	u64 fvco;
+	s64 scaled_ppm;
+};
+
+/**
+ * struct idtxp_int_rate - An output frequency reachable in integer mode.
+ * @rate:		output frequency rounded to the nearest Hz
+ * @divo:		output clock divider
+ * @divnint:		int component of feedback divider
+ */
+struct idtxp_int_rate {
+	u32 rate;
+	u16 divo;
+	u8 divnint;
+};
+
+/**
+ * struct idtxp_solver - Everything the divider solver depends on.
+ * @pfd:		phase detector frequency, fxtal after the doubler
+ * @pfd_recip:		floor(2^64 / pfd), used instead of dividing by pfd
+ * @int_only:		only program integer feedback dividers
+ * @int_tol:		largest error, in scaled ppm, accepted to use an integer
+ *			feedback divider in place of a fractional one
+ * @int_rates:		integer mode output frequencies, sorted by rate
+ * @num_int_rates:	number of entries in int_rates
+ */
+struct idtxp_solver {
+	u32 pfd;
+	u64 pfd_recip;
+	bool int_only;
+	s64 int_tol;
+	struct idtxp_int_rate *int_rates;
+	unsigned int num_int_rates;
+};
+
+/**
+ * bit_to_shift() - Number of bits to shift given specified mask.
+ * @mask:	32-bit word input to count zero bits on right.
+ *
+ * Return: Number of bits to shift.
+ */
+static inline int bit_to_shift(unsigned int mask)
+{
+	unsigned int c = 32;
+
+	mask &= ~mask + 1;
+	if (mask)
+		c--;
+	if (mask & 0x0000FFFF)
+		c -= 16;
+	if (mask & 0x00FF00FF)
+		c -= 8;
+	if (mask & 0x0F0F0F0F)
+		c -= 4;
+	if (mask & 0x33333333)
+		c -= 2;
+	if (mask & 0x55555555)
+		c -= 1;
+	return c;
+}
+
+static inline void set_to_reg(u8 *reg, u8 val, unsigned int mask)
+{
+	*reg = ((*reg) & ~mask ) | ((val << bit_to_shift(mask)) & mask);
+}
+
+static inline void get_from_reg(u8 reg, u8 *val, unsigned int mask)
+{
+	*val = (reg & mask) >> bit_to_shift(mask);
+}
+
+void idtxp_solver_set_pfd(struct idtxp_solver *solver, u32 fxtal,
+			  bool dblr_dis);
+s64 idtxp_scaled_ppm(s64 diff, u64 ref);
+u64 idtxp_divn_total(u16 divnint, u32 divnfrac);
+unsigned long idtxp_divs_rate(const struct idtxp_solver *solver,
+			      const struct idtxp_divs *divs);
+int idtxp_solve_frac(const struct idtxp_solver *solver, u32 fout, u16 divo,
+		     struct idtxp_divs *divs);
+int idtxp_solve_divs(const struct idtxp_solver *solver, u32 fout,
+		     struct idtxp_divs *divs);
+unsigned int idtxp_int_rates_max(const struct idtxp_solver *solver);
+unsigned int idtxp_int_rates_fill(const struct idtxp_solver *solver,
+				  u64 min_freq, u64 max_freq,
+				  struct idtxp_int_rate *tbl);
+int idtxp_solve_int_divs(const struct idtxp_solver *solver, u32 fout,
+			 struct idtxp_divs *divs);
+int idtxp_find_divs(const struct idtxp_solver *solver, u32 fout,
+		    struct idtxp_divs *divs);
+u8 idtxp_charge_pump(u64 fvco);
+int idtxp_xo_settings(u32 fxtal, struct clk_xo_setting *xo);
+
+#endif /* __CLK_IDTXP_CORE_H */
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/* clk_idtxp_ioctl.h - Character device interface of the xp family driver.
+ *
+ * Copyright (C) 2018, Integrated Device Technology, Inc. <@idt.com>
+ *
+ * Every device gets a /dev/idtxp-<i2c device name> node. The ioctls
+ * below program and inspect it. read() returns whole struct idtxp_event
+ * records, and poll() reports readable while one is pending. Each open
+ * file has its own event queue, holding the IDTXP_EVENT_QUEUE_LEN most
+ * recent events.
+ */
+
+#ifndef __CLK_IDTXP_IOCTL_H
+#define __CLK_IDTXP_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define IDTXP_EVENT_QUEUE_LEN	16
+#define IDTXP_BATCH_MAX		64
+
+/**
+ * enum idtxp_rate_policy - How a rate change reaches the output.
+ * @IDTXP_RATE_AUTO:	small change without a PLL relock within 0.05% of
+ *			the current rate, large change otherwise
+ * @IDTXP_RATE_SMALL:	small change, refused with -ERANGE beyond 0.05%
+ * @IDTXP_RATE_LARGE:	large change with a PLL relock
+ * @IDTXP_RATE_GLIDE:	glide to the rate in small changes at most @slew
+ *			Hz/s fast, keeping the output divider
+ *
+ * All but IDTXP_RATE_GLIDE set the rate as clk_set_rate() does, within the
+ * rate range of the clock consumers, and fail with -EBUSY while one of them
+ * holds the rate exclusive.
+ */
+enum idtxp_rate_policy {
+	IDTXP_RATE_AUTO,
+	IDTXP_RATE_SMALL,
+	IDTXP_RATE_LARGE,
+	IDTXP_RATE_GLIDE,
+};
+
+/**
+ * struct idtxp_rate_req - A rate change.
+ * @rate:		output frequency (in Hz)
+ * @policy:		enum idtxp_rate_policy
+ * @slew:		largest rate of change (in Hz/s), IDTXP_RATE_GLIDE only
+ * @reserved:		must be zero
+ */
+struct idtxp_rate_req {
+	__u32 rate;
+	__u32 policy;
+	__u32 slew;
+	__u32 reserved;
+};
+
+/**
+ * struct idtxp_xo_state - XO and output settings, as in the registers.
+ *
+ * The fields are those of the XO setting registers 0x50-0x57, see the
+ * device datasheet.
+ */
+struct idtxp_xo_state {
+	__u8 hsp_i2c_en;
+	__u8 cmos_en;
+	__u8 dblr_dis;
+	__u8 vdd_def;
+	__u8 vcxo_dis;
+	__u8 vcxo_bw;
+	__u8 vcxo_gslope;
+	__u8 vcxo_gexp;
+	__u8 vcxo_gscale;
+	__u8 oe_pol_en;
+	__u8 drv_type;
+	__u8 gm;
+	__u8 cap_x1;
+	__u8 ampslice;
+	__u8 bypass;
+	__u8 cap_x2;
+	__u8 ot_dis;
+	__u8 ot_res;
+	__u8 reserved[6];
+};
+
+/**
+ * struct idtxp_state - Decoded state of the device.
+ * @req_freq:		last requested output frequency (in Hz)
+ * @act_freq:		actual output frequency, rounded (in Hz)
+ * @rate_num:		numerator of the exact output frequency (in Hz)
+ * @rate_den:		denominator of the exact output frequency
+ * @scaled_ppm:		error of act_freq against req_freq, in ppm with a
+ *			16-bit binary fractional field
+ * @fvco:		VCO frequency (in Hz)
+ * @fxtal:		XO frequency (in Hz)
+ * @pfd:		phase detector frequency (in Hz)
+ * @divnfrac:		24-bit fractional component of the feedback divider
+ * @divo:		output divider
+ * @divnint:		integer component of the feedback divider
+ * @icp_value:		charge pump value
+ * @icp_offset_en:	charge pump offset enable
+ * @pll_mode:		pll mode
+ * @locked:		the output of the last rate change is usable, 0 also
+ *			after a PLL lock timeout
+ * @glide_active:	a glide is in progress
+ * @suspended:		the device is suspended, changes are only staged
+ * @reserved:		zero
+ * @xo:			XO and output settings
+ */
+struct idtxp_state {
+	__u32 req_freq;
+	__u32 act_freq;
+	__u64 rate_num;
+	__u64 rate_den;
+	__s64 scaled_ppm;
+	__u64 fvco;
+	__u32 fxtal;
+	__u32 pfd;
+	__u32 divnfrac;
+	__u16 divo;
+	__u16 divnint;
+	__u8 icp_value;
+	__u8 icp_offset_en;
+	__u8 pll_mode;
+	__u8 locked;
+	__u8 glide_active;
+	__u8 suspended;
+	__u8 reserved[2];
+	struct idtxp_xo_state xo;
+};
+
+/**
+ * enum idtxp_op_type - Operations of a batch.
+ * @IDTXP_OP_SET_RATE:	change the rate as IDTXP_IOC_SET_RATE
+ * @IDTXP_OP_WRITE_REG:	write a register; consecutive writes of a batch
+ *			are applied atomically as coalesced block writes
+ * @IDTXP_OP_GET_STATE:	copy the state as IDTXP_IOC_GET_STATE
+ */
+enum idtxp_op_type {
+	IDTXP_OP_SET_RATE = 1,
+	IDTXP_OP_WRITE_REG,
+	IDTXP_OP_GET_STATE,
+};
+
+/**
+ * struct idtxp_op - One operation of a batch.
+ * @type:		enum idtxp_op_type
+ * @result:		set to 0 or a negative errno for each op run
+ * @rate:		IDTXP_OP_SET_RATE argument
+ * @reg:		IDTXP_OP_WRITE_REG register address
+ * @val:		IDTXP_OP_WRITE_REG value
+ * @state:		IDTXP_OP_GET_STATE user pointer to a struct idtxp_state
+ */
+struct idtxp_op {
+	__u32 type;
+	__s32 result;
+	union {
+		struct idtxp_rate_req rate;
+		struct {
+			__u8 reg;
+			__u8 val;
+		};
+		__u64 state;
+		__u8 reserved[16];
+	};
+};
+
+/**
+ * struct idtxp_batch - Operations run in order by one ioctl.
+ * @ops:		user pointer to an array of struct idtxp_op
+ * @num:		number of ops, at most IDTXP_BATCH_MAX
+ * @done:		set to the number of ops run; the batch stops at the
+ *			first op that fails
+ */
+struct idtxp_batch {
+	__u64 ops;
+	__u32 num;
+	__u32 done;
+};
+
+/**
+ * enum idtxp_event_type - Events read from the device node.
+ * @IDTXP_EVENT_RATE_DONE:	a rate change finished, @err is its result
+ * @IDTXP_EVENT_PLL_LOCKED:	the PLL locked after a large change, @err is
+ *				-ETIMEDOUT if it was not seen locked
+ * @IDTXP_EVENT_GLIDE_DONE:	a glide ended, -ECANCELED if aborted
+ */
+enum idtxp_event_type {
+	IDTXP_EVENT_RATE_DONE = 1,
+	IDTXP_EVENT_PLL_LOCKED,
+	IDTXP_EVENT_GLIDE_DONE,
+};
+
+/**
+ * struct idtxp_event - An event of the device.
+ * @timestamp_ns:	CLOCK_MONOTONIC time of the event (in ns)
+ * @type:		enum idtxp_event_type
+ * @rate:		output frequency once done (in Hz)
+ * @err:		0 or a negative errno
+ * @reserved:		zero
+ */
+struct idtxp_event {
+	__u64 timestamp_ns;
+	__u32 type;
+	__u32 rate;
+	__s32 err;
+	__u32 reserved;
+};
+
+#define IDTXP_IOC_MAGIC		0xB9
+
+#define IDTXP_IOC_SET_RATE	_IOW(IDTXP_IOC_MAGIC, 0x01, struct idtxp_rate_req)
+#define IDTXP_IOC_GET_STATE	_IOR(IDTXP_IOC_MAGIC, 0x02, struct idtxp_state)
+#define IDTXP_IOC_BATCH		_IOWR(IDTXP_IOC_MAGIC, 0x03, struct idtxp_batch)
+/* Trim the rate last set by a __s64 in ppm with a 16-bit fractional field */
+#define IDTXP_IOC_ADJFINE	_IOW(IDTXP_IOC_MAGIC, 0x04, __s64)
+/*
+ * Solve the settings of the __u32 rate (in Hz) expected next ahead of time,
+ * so that the switch to it only writes the divider registers
+ */
+#define IDTXP_IOC_PRESTAGE	_IOW(IDTXP_IOC_MAGIC, 0x05, __u32)
+
+#endif /* __CLK_IDTXP_IOCTL_H */
@@ -0,0 +1,1127 @@
+// SPDX-License-Identifier: GPL-2.0
+/* clk_idtxp_test.c - KUnit tests for the xp family driver.
+ *
+ * Copyright (C) 2018, Integrated Device Technology, Inc. <@idt.com>
+ *
+ * Included at the end of clk_idtxp.c when CONFIG_CLK_IDTXP_KUNIT_TEST is
+ * set, so the static helpers can be tested directly. The driver sits on a
+ * RAM backed regmap bus that counts what would go over I2C, so a change
+ * that adds bus traffic to a hot path fails here. Runs under UML:
+ *
+ *   ./tools/testing/kunit/kunit.py run \
+ *	--kconfig_add CONFIG_CLK_IDTXP=y \
+ *	--kconfig_add CONFIG_CLK_IDTXP_KUNIT_TEST=y 'clk-idtxp*'
+ */
+
+#include <kunit/test.h>
+
+/**
+ * struct idtxp_test_bus - RAM backed register space of a fake device.
+ * @regs:		device registers
+ * @xfers:		bus transactions since the last reset
+ * @bytes:		bytes transferred, register address included
+ * @reg_writes:		registers written
+ * @freq_chg:		OR of all values written to IDTXP_REG_FREQ_CHG
+ * @unlocked_polls:	reads of IDTXP_REG_CONTROL still to report the PLL
+ *			unlocked, after which LOCK_PLL reads as set
+ * @lock_polls:		reads of IDTXP_REG_CONTROL
+ */
+struct idtxp_test_bus {
+	u8 regs[NUM_CONFIG_REGISTERS];
+	unsigned int xfers;
+	unsigned int bytes;
+	unsigned int reg_writes;
+	u8 freq_chg;
+	unsigned int unlocked_polls;
+	unsigned int lock_polls;
+};
+
+static int idtxp_test_bus_write(void *context, const void *buf, size_t count)
+{
+	struct idtxp_test_bus *bus = context;
+	const u8 *p = buf;
+	unsigned int reg = p[0];
+	size_t i;
+
+	bus->xfers++;
+	bus->bytes += count;
+	for (i = 1; i < count && reg < NUM_CONFIG_REGISTERS; i++, reg++) {
+		bus->regs[reg] = p[i];
+		bus->reg_writes++;
+		if (reg == IDTXP_REG_FREQ_CHG)
+			bus->freq_chg |= p[i];
+	}
+
+	return 0;
+}
+
+static int idtxp_test_bus_read(void *context, const void *reg_buf,
+			       size_t reg_size, void *val_buf, size_t val_size)
+{
+	struct idtxp_test_bus *bus = context;
+	unsigned int reg = *(const u8 *)reg_buf;
+
+	if (reg + val_size > NUM_CONFIG_REGISTERS)
+		return -EINVAL;
+
+	bus->xfers++;
+	bus->bytes += reg_size + val_size;
+	memcpy(val_buf, &bus->regs[reg], val_size);
+
+	if (reg == IDTXP_REG_CONTROL) {
+		bus->lock_polls++;
+		if (bus->unlocked_polls)
+			bus->unlocked_polls--;
+		else
+			*(u8 *)val_buf |= IDTXP_LOCK_PLL_MASK;
+	}
+
+	return 0;
+}
+
+static const struct regmap_bus idtxp_test_regmap_bus = {
+	.write = idtxp_test_bus_write,
+	.read = idtxp_test_bus_read,
+};
+
+struct idtxp_test_ctx {
+	struct clk_idtxp *data;
+	struct idtxp_test_bus *bus;
+	struct i2c_client *client;
+	struct i2c_adapter *adapter;
+};
+
+static void idtxp_test_reset_counts(struct idtxp_test_bus *bus)
+{
+	bus->xfers = 0;
+	bus->bytes = 0;
+	bus->reg_writes = 0;
+	bus->freq_chg = 0;
+	bus->lock_polls = 0;
+}
+
+static void idtxp_test_release(struct device *dev)
+{
+}
+
+/* Runtime PM reaches the driver callbacks through the device type */
+static const struct device_type idtxp_test_dev_type = {
+	.name = "idtxp-test",
+	.pm = &idtxp_pm_ops,
+};
+
+static int idtxp_test_init(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx;
+	struct clk_idtxp *data;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+	ctx->bus = kunit_kzalloc(test, sizeof(*ctx->bus), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->bus);
+	ctx->client = kunit_kzalloc(test, sizeof(*ctx->client), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->client);
+	ctx->adapter = kunit_kzalloc(test, sizeof(*ctx->adapter), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx->adapter);
+	ctx->client->adapter = ctx->adapter;
+	data = kunit_kzalloc(test, sizeof(*data), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, data);
+
+	device_initialize(&ctx->client->dev);
+	ctx->client->dev.release = idtxp_test_release;
+	ctx->client->dev.type = &idtxp_test_dev_type;
+	KUNIT_ASSERT_EQ(test, dev_set_name(&ctx->client->dev, "idtxp-test"), 0);
+
+	data->i2c_client = ctx->client;
+	data->min_freq = IDTXP_MIN_FREQ;
+	data->max_freq = IDTXP_MAX_FREQ;
+	idtxp_init_data(data);
+	/* The test bus reports LOCK_PLL, see unlocked_polls */
+	data->lock_readback = true;
+	data->regmap = devm_regmap_init(&ctx->client->dev,
+					&idtxp_test_regmap_bus, ctx->bus,
+					&idtxp_regmap_config);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(data->regmap));
+	i2c_set_clientdata(ctx->client, data);
+	pm_runtime_set_active(&ctx->client->dev);
+
+	ctx->data = data;
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void idtxp_test_exit(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+
+	put_device(&ctx->client->dev);
+}
+
+/* Read the device state and set up a crystal, like probe does */
+static void idtxp_test_setup_xtal(struct kunit *test, u32 fxtal)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+
+	KUNIT_ASSERT_EQ(test, idtxp_get_defaults(data), 0);
+	data->fxtal = fxtal;
+	KUNIT_ASSERT_EQ(test, idtxp_calc_xo_settings(data), 0);
+	idtxp_update_pfd(data);
+	idtxp_update_rate(data);
+	idtxp_test_reset_counts(ctx->bus);
+}
+
+static void idtxp_test_solve_int(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	struct idtxp_divs divs;
+
+	data->fxtal = 50000000;
+	idtxp_update_pfd(data);
+
+	KUNIT_ASSERT_EQ(test,
+			idtxp_solve_divs(&data->solver, 100000000, &divs), 0);
+	KUNIT_EXPECT_EQ(test, divs.divo, 69);
+	KUNIT_EXPECT_EQ(test, divs.divnint, 69);
+	KUNIT_EXPECT_EQ(test, divs.divnfrac, 0);
+	KUNIT_EXPECT_EQ(test, divs.fvco, 6900000000ULL);
+	KUNIT_EXPECT_EQ(test, divs.scaled_ppm, 0);
+}
+
+static void idtxp_test_solve_frac(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	struct idtxp_divs divs;
+
+	data->fxtal = 114285000;
+	data->xo.dblr_dis = true;
+	idtxp_update_pfd(data);
+
+	KUNIT_ASSERT_EQ(test,
+			idtxp_solve_divs(&data->solver, 100000000, &divs), 0);
+	KUNIT_EXPECT_EQ(test, divs.divo, 69);
+	KUNIT_EXPECT_EQ(test, divs.divnint, 60);
+	KUNIT_EXPECT_EQ(test, divs.divnfrac, 6297787);
+	/* Within half an LSB of the 24-bit fraction, about 0.3 ppb */
+	KUNIT_EXPECT_LE(test, abs(divs.scaled_ppm), 65536 / 1000);
+	KUNIT_EXPECT_EQ(test, idtxp_divs_rate(&data->solver, &divs),
+			100000000UL);
+}
+
+static void idtxp_test_solve_range(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	struct idtxp_divs divs;
+
+	data->fxtal = 50000000;
+	idtxp_update_pfd(data);
+
+	KUNIT_EXPECT_EQ(test, idtxp_solve_divs(&data->solver, 10000000, &divs),
+			-ERANGE);
+	KUNIT_EXPECT_EQ(test, idtxp_solve_divs(&data->solver, 0, &divs), -EINVAL);
+}
+
+static void idtxp_test_int_rates(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	struct idtxp_divs divs;
+	unsigned int i;
+
+	data->fxtal = 50000000;
+	idtxp_update_pfd(data);
+	KUNIT_ASSERT_EQ(test, idtxp_build_int_rates(data), 0);
+	KUNIT_ASSERT_GT(test, data->solver.num_int_rates, 0);
+	/* Only the deduplicated rates are kept */
+	KUNIT_EXPECT_LT(test, data->solver.num_int_rates,
+			idtxp_int_rates_max(&data->solver));
+
+	for (i = 1; i < data->solver.num_int_rates; i++)
+		KUNIT_ASSERT_LT(test, data->solver.int_rates[i - 1].rate,
+				data->solver.int_rates[i].rate);
+
+	KUNIT_ASSERT_EQ(test,
+			idtxp_solve_int_divs(&data->solver, 100000010, &divs),
+			0);
+	KUNIT_EXPECT_EQ(test, divs.divo, 69);
+	KUNIT_EXPECT_EQ(test, divs.divnint, 69);
+	KUNIT_EXPECT_EQ(test, divs.divnfrac, 0);
+	KUNIT_EXPECT_LT(test, divs.scaled_ppm, 0);
+}
+
+static void idtxp_test_charge_pump(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+
+	data->fvco = 6900000000ULL;
+	idtxp_calc_charge_pump(data);
+	KUNIT_EXPECT_EQ(test, data->icp_value, 5);
+
+	data->fvco = 7000000000ULL;
+	idtxp_calc_charge_pump(data);
+	KUNIT_EXPECT_EQ(test, data->icp_value, 4);
+
+	data->fvco = 7400000000ULL;
+	idtxp_calc_charge_pump(data);
+	KUNIT_EXPECT_EQ(test, data->icp_value, 3);
+
+	data->fvco = 8600000000ULL;
+	idtxp_calc_charge_pump(data);
+	KUNIT_EXPECT_EQ(test, data->icp_value, 2);
+}
+
+static void idtxp_test_xo_settings(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+
+	data->fxtal = 50000000;
+	KUNIT_EXPECT_EQ(test, idtxp_calc_xo_settings(data), 0);
+	KUNIT_EXPECT_FALSE(test, data->xo.dblr_dis);
+	KUNIT_EXPECT_EQ(test, data->xo.cap_x1, 0x3C);
+
+	data->fxtal = 156250000;
+	KUNIT_EXPECT_EQ(test, idtxp_calc_xo_settings(data), 0);
+	KUNIT_EXPECT_TRUE(test, data->xo.dblr_dis);
+	KUNIT_EXPECT_EQ(test, data->xo.ot_res, 0x3);
+
+	data->fxtal = 90000000;
+	KUNIT_EXPECT_EQ(test, idtxp_calc_xo_settings(data), -EINVAL);
+}
+
+static void idtxp_test_read_defaults(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+
+	unsigned int val;
+
+	ctx->bus->regs[IDTXP_REG_DIVO_7_0] = 69;
+	ctx->bus->regs[IDTXP_REG_DIVO_8_DIVN_INT_6_0] = 69;
+
+	/* The regmap fills its cache with one read of the whole space */
+	idtxp_test_reset_counts(ctx->bus);
+	ctx->data->regmap = devm_regmap_init(&ctx->client->dev,
+					     &idtxp_test_regmap_bus, ctx->bus,
+					     &idtxp_regmap_config);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(ctx->data->regmap));
+	KUNIT_EXPECT_EQ(test, ctx->bus->xfers, 1);
+	KUNIT_EXPECT_EQ(test, ctx->bus->bytes, 1 + NUM_CONFIG_REGISTERS);
+	idtxp_test_reset_counts(ctx->bus);
+
+	/* which serves the readback without touching the bus */
+	KUNIT_ASSERT_EQ(test, idtxp_get_defaults(ctx->data), 0);
+	KUNIT_EXPECT_EQ(test, ctx->data->divo, 69);
+	KUNIT_EXPECT_EQ(test, ctx->data->divnint, 69);
+	KUNIT_EXPECT_EQ(test, ctx->bus->xfers, 0);
+
+	/* Only the volatile registers are read from the device */
+	KUNIT_ASSERT_EQ(test, regmap_read(ctx->data->regmap,
+					  IDTXP_REG_CONTROL, &val), 0);
+	KUNIT_EXPECT_EQ(test, ctx->bus->xfers, 1);
+	KUNIT_EXPECT_EQ(test, ctx->bus->reg_writes, 0);
+
+	/* A device already at its rate needs no programming */
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&ctx->data->hw, 100000000, 0), 0);
+	KUNIT_EXPECT_TRUE(test, idtxp_rate_is_set(ctx->data, 100000000));
+	KUNIT_EXPECT_FALSE(test, idtxp_rate_is_set(ctx->data, 100000010));
+}
+
+/* Run the register part of probe on a fresh device state over ctx->bus */
+static struct clk_idtxp *idtxp_test_probe(struct kunit *test,
+					  bool has_settings)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data;
+
+	data = kunit_kzalloc(test, sizeof(*data), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, data);
+	data->i2c_client = ctx->client;
+	data->min_freq = IDTXP_MIN_FREQ;
+	data->max_freq = IDTXP_MAX_FREQ;
+	data->fxtal = 50000000;
+	idtxp_init_data(data);
+
+	/* DT settings matching what the device holds */
+	data->has_settings = has_settings;
+	if (has_settings)
+		memcpy(data->settings, ctx->bus->regs, NUM_CONFIG_REGISTERS);
+
+	data->regmap = devm_regmap_init(&ctx->client->dev,
+					&idtxp_test_regmap_bus, ctx->bus,
+					&idtxp_regmap_config);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(data->regmap));
+	i2c_set_clientdata(ctx->client, data);
+
+	KUNIT_ASSERT_EQ(test, idtxp_init_regs(data, idtxp_xo, -1), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_init_rate(data, 100000000), 0);
+
+	return data;
+}
+
+static void idtxp_test_probe_xfers(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data;
+
+	/*
+	 * A cold device gets the fill read, the XO settings as three block
+	 * writes, the dividers as one, then the setup sequence and the
+	 * trigger of a large change. LOCK_PLL is not polled by default.
+	 */
+	idtxp_test_reset_counts(bus);
+	data = idtxp_test_probe(test, false);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 1 + 3 + 1 + 3 + 2);
+	KUNIT_EXPECT_EQ(test, bus->lock_polls, 0);
+	KUNIT_EXPECT_TRUE(test, completion_done(&data->pll_locked));
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000000);
+
+	/* One fill read and nothing else once it is set up */
+	idtxp_test_reset_counts(bus);
+	data = idtxp_test_probe(test, false);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 1);
+	KUNIT_EXPECT_EQ(test, bus->reg_writes, 0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000000);
+
+	idtxp_test_reset_counts(bus);
+	data = idtxp_test_probe(test, true);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 1);
+	KUNIT_EXPECT_EQ(test, bus->reg_writes, 0);
+}
+
+static void idtxp_test_set_rate_large(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+
+	idtxp_test_setup_xtal(test, 50000000);
+
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+
+	/*
+	 * 0x10-0x12 in one burst, three setup and two trigger writes, then
+	 * a single LOCK_PLL poll
+	 */
+	KUNIT_EXPECT_EQ(test, bus->xfers, 7);
+	KUNIT_EXPECT_EQ(test, bus->reg_writes, 8);
+	KUNIT_EXPECT_EQ(test, bus->bytes, 16);
+	KUNIT_EXPECT_EQ(test, bus->lock_polls, 1);
+	KUNIT_EXPECT_TRUE(test, completion_done(&data->pll_locked));
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_LARGE_FREQ_CHG_MASK);
+
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_DIVO_7_0], 0x45);
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_DIVO_8_DIVN_INT_6_0], 0x45);
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_ICP_DIVN_INT_8_7_MODE], 0x0A);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000000);
+	KUNIT_EXPECT_EQ(test, data->scaled_ppm, 0);
+}
+
+static void idtxp_test_set_rate_small(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	idtxp_test_reset_counts(bus);
+
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000010, 0), 0);
+
+	/* Only DIVN_FRAC[7:0] changes, and the PLL does not relock */
+	KUNIT_EXPECT_EQ(test, bus->xfers, 6);
+	KUNIT_EXPECT_EQ(test, bus->lock_polls, 0);
+	KUNIT_EXPECT_EQ(test, bus->reg_writes, 6);
+	KUNIT_EXPECT_EQ(test, bus->bytes, 12);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_SMALL_FREQ_CHG_MASK);
+
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_DIVN_FRAC_7_0], 116);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000010);
+	KUNIT_EXPECT_LE(test, abs(data->scaled_ppm), 65536 / 1000);
+}
+
+static void idtxp_test_set_rate_cached(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000010, 0), 0);
+	idtxp_test_reset_counts(bus);
+
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000010, 0), 0);
+
+	/* Nothing to write, only the setup and trigger sequences */
+	KUNIT_EXPECT_EQ(test, data->rate_cache_hits, 1);
+	KUNIT_EXPECT_EQ(test, data->rate_cache_misses, 1);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 5);
+	KUNIT_EXPECT_EQ(test, bus->reg_writes, 5);
+}
+
+static void idtxp_test_latency_hist(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	const struct idtxp_hist *hist;
+	u64 sum;
+	int phase, i;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000010, 0), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000020, 0), 0);
+
+	for (phase = 0; phase < IDTXP_NUM_PHASES; phase++) {
+		hist = &data->hist[IDTXP_PATH_LARGE][phase];
+		KUNIT_EXPECT_EQ(test, hist->count, 1);
+		hist = &data->hist[IDTXP_PATH_SMALL][phase];
+		KUNIT_EXPECT_EQ(test, hist->count,
+				phase == IDTXP_PHASE_PLL_LOCK ? 0 : 2);
+
+		for (i = 0, sum = 0; i < IDTXP_HIST_BUCKETS; i++)
+			sum += hist->buckets[i];
+		KUNIT_EXPECT_EQ(test, sum, hist->count);
+		KUNIT_EXPECT_LE(test, idtxp_hist_percentile(hist, 50),
+				hist->max_ns);
+	}
+}
+
+static void idtxp_test_pll_lock_wait(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	bus->unlocked_polls = 3;
+
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_EXPECT_EQ(test, bus->lock_polls, 4);
+	KUNIT_EXPECT_TRUE(test, completion_done(&data->pll_locked));
+	KUNIT_EXPECT_NE(test, data->lock_est_ns, IDTXP_LOCK_EST_NS);
+
+	idtxp_test_reset_counts(bus);
+	bus->unlocked_polls = UINT_MAX;
+
+	/* The change is taken, its lock failure only recorded */
+	KUNIT_EXPECT_EQ(test, idtxp_set_rate(&data->hw, 200000000, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 200000000);
+	KUNIT_EXPECT_TRUE(test, completion_done(&data->pll_locked));
+	KUNIT_EXPECT_EQ(test, data->pll_lock_err, -ETIMEDOUT);
+
+	/* which holds nothing off, and the next lock clears it */
+	bus->unlocked_polls = 0;
+	KUNIT_EXPECT_EQ(test, idtxp_adjfine(data, 65536), 0);
+	KUNIT_EXPECT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->pll_lock_err, 0);
+}
+
+static void idtxp_test_async_coalesce(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	data->async_rate = true;
+
+	/* Hold the worker off the device while the burst is queued */
+	mutex_lock(&data->lock);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 150000000, 0), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 200000000, 0), 0);
+	KUNIT_EXPECT_FALSE(test, completion_done(&data->rate_done));
+	mutex_unlock(&data->lock);
+
+	flush_work(&data->rate_work);
+
+	KUNIT_EXPECT_TRUE(test, completion_done(&data->rate_done));
+	KUNIT_EXPECT_EQ(test, data->rate_err, 0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 200000000);
+	KUNIT_EXPECT_EQ(test, data->rate_requests, 3);
+	KUNIT_EXPECT_GE(test, data->rate_coalesced, 1);
+	KUNIT_EXPECT_LE(test, bus->lock_polls, 2);
+}
+
+static void idtxp_test_glide(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	u16 divo;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	divo = data->divo;
+	idtxp_test_reset_counts(bus);
+
+	/* 0.1% at 100 MHz/s: three steps of at most 0.04%, 1 ms apart */
+	KUNIT_ASSERT_EQ(test, idtxp_glide_start(data, 100100000, 100000000),
+			0);
+	KUNIT_ASSERT_NE(test, wait_for_completion_timeout(&data->glide_done,
+							  msecs_to_jiffies(1000)),
+			0);
+
+	KUNIT_EXPECT_EQ(test, data->glide_err, 0);
+	KUNIT_EXPECT_EQ(test, data->glide_steps, 3);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100100000);
+	KUNIT_EXPECT_EQ(test, data->divo, divo);
+	KUNIT_EXPECT_LE(test, data->glide_slew, 100000000);
+	KUNIT_EXPECT_EQ(test, bus->lock_polls, 0);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_SMALL_FREQ_CHG_MASK);
+	KUNIT_EXPECT_EQ(test, data->hist[IDTXP_PATH_GLIDE][IDTXP_PHASE_TOTAL].count,
+			3);
+
+	/* Out of reach of the current DIVO */
+	KUNIT_EXPECT_EQ(test, idtxp_glide_start(data, 150000000, 100000000),
+			-ERANGE);
+}
+
+static void idtxp_test_glide_runtime_pm(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	struct device *dev = &ctx->client->dev;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	pm_runtime_enable(dev);
+	KUNIT_ASSERT_EQ(test, pm_runtime_suspend(dev), 0);
+	KUNIT_ASSERT_TRUE(test, data->suspended);
+
+	/* A glide resumes the device and keeps it resumed until it ends */
+	KUNIT_ASSERT_EQ(test, idtxp_glide_start(data, 100010000, 10000000),
+			0);
+	KUNIT_EXPECT_FALSE(test, data->suspended);
+	KUNIT_EXPECT_EQ(test, atomic_read(&dev->power.usage_count), 1);
+	KUNIT_EXPECT_EQ(test, pm_runtime_suspend(dev), -EAGAIN);
+
+	/* A new glide ends the one in progress, with its reference */
+	KUNIT_ASSERT_EQ(test, idtxp_glide_start(data, 100010000, 10000000),
+			0);
+	KUNIT_EXPECT_EQ(test, atomic_read(&dev->power.usage_count), 1);
+
+	KUNIT_ASSERT_NE(test, wait_for_completion_timeout(&data->glide_done,
+							  msecs_to_jiffies(1000)),
+			0);
+	KUNIT_EXPECT_EQ(test, data->glide_err, 0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100010000);
+	KUNIT_EXPECT_EQ(test, atomic_read(&dev->power.usage_count), 0);
+	KUNIT_EXPECT_EQ(test, pm_runtime_suspend(dev), 0);
+
+	pm_runtime_disable(dev);
+}
+
+static void idtxp_test_presets(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	static const u32 rates[] = { 100000000, 156250000, 100000010 };
+	struct clk_rate_request req = { .rate = 100000010 };
+	u16 divo;
+	int i;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	data->presets = kunit_kcalloc(test, ARRAY_SIZE(rates),
+				      sizeof(*data->presets), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, data->presets);
+	for (i = 0; i < ARRAY_SIZE(rates); i++)
+		data->presets[i].rate = rates[i];
+	data->num_presets = ARRAY_SIZE(rates);
+
+	/* Solving the presets leaves the current dividers alone */
+	divo = data->divo;
+	KUNIT_ASSERT_EQ(test, idtxp_solve_presets(data), 0);
+	KUNIT_EXPECT_EQ(test, data->divo, divo);
+	KUNIT_EXPECT_EQ(test, data->presets[1].act_rate, 156250000);
+
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_determine_rate(&data->hw, &req), 0);
+	idtxp_test_reset_counts(bus);
+
+	/* A switch to a preset neither solves nor reads back */
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, req.rate, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->rate_cache_hits + data->rate_cache_misses,
+			0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 6);
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_DIVN_FRAC_7_0], 116);
+	KUNIT_EXPECT_EQ(test, data->req_freq, 100000010);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000010);
+
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 156250000, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->rate_cache_hits + data->rate_cache_misses,
+			0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 156250000);
+
+	/* A preset that no longer solves is unused, the others still are */
+	data->presets[0].rate = 1;
+	divo = data->divo;
+	KUNIT_EXPECT_LT(test, idtxp_solve_presets(data), 0);
+	KUNIT_EXPECT_EQ(test, data->presets[0].act_rate, 0);
+	KUNIT_EXPECT_EQ(test, data->presets[1].act_rate, 156250000);
+	KUNIT_EXPECT_EQ(test, data->presets[2].act_rate, 100000010);
+	KUNIT_EXPECT_EQ(test, data->divo, divo);
+	KUNIT_EXPECT_NULL(test, idtxp_find_preset(data, 100000000));
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->rate_cache_hits + data->rate_cache_misses,
+			1);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000000);
+}
+
+static void idtxp_test_nvm_commit(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	idtxp_nvm_snapshot(data);
+
+	/* NVM already holds the registers, nothing to write */
+	KUNIT_ASSERT_EQ(test, idtxp_nvm_commit(data), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 0);
+	KUNIT_EXPECT_EQ(test, data->nvm_writes, 0);
+
+	/* Rate changes and trims leave NVM alone */
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_adjfine(data, 65536), 0);
+	KUNIT_EXPECT_EQ(test, data->nvm_writes, 0);
+	idtxp_test_reset_counts(bus);
+
+	/* The copy is a pulse of the NVM bit in the control register */
+	KUNIT_ASSERT_EQ(test, idtxp_nvm_commit(data), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 2);
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_CONTROL], 0);
+	KUNIT_EXPECT_EQ(test, data->nvm_writes, 1);
+
+	idtxp_test_reset_counts(bus);
+	KUNIT_ASSERT_EQ(test, idtxp_nvm_commit(data), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 0);
+	KUNIT_EXPECT_EQ(test, data->nvm_writes, 1);
+
+	/* Not while the PLL is still locking */
+	reinit_completion(&data->pll_locked);
+	KUNIT_EXPECT_EQ(test, idtxp_nvm_commit(data), -EBUSY);
+}
+
+static void idtxp_test_pm_restore(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	struct device *dev = &ctx->client->dev;
+	unsigned int polls;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	idtxp_nvm_snapshot(data);
+
+	/* Suspended, a rate change is only staged */
+	KUNIT_ASSERT_EQ(test, idtxp_suspend(dev), 0);
+	idtxp_test_reset_counts(bus);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 156250000, 0), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 156250000);
+	KUNIT_EXPECT_EQ(test, idtxp_nvm_commit(data), -EBUSY);
+	/* Runtime PM cannot resume the device while the system sleeps */
+	KUNIT_EXPECT_EQ(test, idtxp_glide_start(data, 156260000, 100000),
+			-EBUSY);
+
+	/* and written with a PLL relock once resumed */
+	KUNIT_ASSERT_EQ(test, idtxp_runtime_resume(dev), 0);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_LARGE_FREQ_CHG_MASK);
+	KUNIT_EXPECT_EQ(test, memcmp(&bus->regs[IDTXP_REG_DIVO_7_0],
+				     data->div_regs, NUM_FREQ_REGISTERS), 0);
+
+	/* After a power loss only what differs from NVM is rewritten */
+	KUNIT_ASSERT_EQ(test, idtxp_suspend(dev), 0);
+	memcpy(bus->regs, data->nvm_regs, NUM_CONFIG_REGISTERS);
+	idtxp_test_reset_counts(bus);
+	KUNIT_ASSERT_EQ(test, idtxp_resume(dev), 0);
+	KUNIT_EXPECT_EQ(test, memcmp(bus->regs, data->regs,
+				     IDTXP_REG_I2C_ADDR), 0);
+	polls = bus->lock_polls;
+	KUNIT_EXPECT_EQ(test, polls, 1);
+	KUNIT_EXPECT_LE(test, bus->xfers - polls, 9);
+
+	/* and nothing at all once NVM holds the registers */
+	idtxp_nvm_snapshot(data);
+	KUNIT_ASSERT_EQ(test, idtxp_suspend(dev), 0);
+	idtxp_test_reset_counts(bus);
+	KUNIT_ASSERT_EQ(test, idtxp_resume(dev), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 0);
+}
+
+static void idtxp_test_snapshot(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	u8 regs[NUM_CONFIG_REGISTERS];
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	idtxp_test_reset_counts(bus);
+
+	/* Only the two trigger registers are read from the device */
+	KUNIT_ASSERT_EQ(test, idtxp_read_snapshot(data, regs), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 2);
+	KUNIT_EXPECT_EQ(test, memcmp(regs, bus->regs, IDTXP_REG_CONTROL), 0);
+	KUNIT_EXPECT_EQ(test, memcmp(&regs[IDTXP_REG_DIVO_7_0], data->div_regs,
+				     NUM_FREQ_REGISTERS), 0);
+}
+
+static void idtxp_test_script(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	struct idtxp_script *script;
+	char text[] = "# new fraction\n13 10\n14 20\n15 30 # msb\n\n"
+		      "atomic\ntrigger\n";
+	char read_only[] = "13 11\n54 01\n";
+	char bad[] = "13\n";
+	char unlocked[] = "13 40\ntrigger\n";
+
+	script = kunit_kzalloc(test, sizeof(*script), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, script);
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	idtxp_test_reset_counts(bus);
+
+	KUNIT_ASSERT_EQ(test, idtxp_parse_script(data, text, script), 0);
+	KUNIT_EXPECT_EQ(test, script->num, 3);
+	KUNIT_EXPECT_TRUE(test, script->atomic);
+	KUNIT_EXPECT_TRUE(test, script->trigger);
+	KUNIT_ASSERT_EQ(test, idtxp_check_script(data, script), 0);
+
+	/* One block write, then the setup, trigger and lock poll */
+	KUNIT_ASSERT_EQ(test, idtxp_apply_script(data, script), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 7);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_LARGE_FREQ_CHG_MASK);
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_DIVN_FRAC_23_16], 0x30);
+	KUNIT_EXPECT_EQ(test, data->divnfrac, 0x302010);
+
+	/* Not atomic, the lock wait is done without the lock held */
+	memset(script, 0, sizeof(*script));
+	KUNIT_ASSERT_EQ(test, idtxp_parse_script(data, unlocked, script), 0);
+	KUNIT_EXPECT_FALSE(test, script->atomic);
+	KUNIT_ASSERT_EQ(test, idtxp_apply_script(data, script), 0);
+	KUNIT_EXPECT_TRUE(test, completion_done(&data->pll_locked));
+	KUNIT_EXPECT_EQ(test, data->divnfrac, 0x302040);
+
+	/* A single bad line rejects the whole script */
+	memset(script, 0, sizeof(*script));
+	KUNIT_ASSERT_EQ(test, idtxp_parse_script(data, read_only, script), 0);
+	KUNIT_EXPECT_EQ(test, idtxp_check_script(data, script), -EINVAL);
+	memset(script, 0, sizeof(*script));
+	KUNIT_EXPECT_EQ(test, idtxp_parse_script(data, bad, script), -EINVAL);
+}
+
+static void idtxp_test_cdev(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	struct idtxp_rate_req req = {
+		.rate = 100100000,
+		.policy = IDTXP_RATE_SMALL,
+	};
+	struct idtxp_op ops[3] = {
+		{ .type = IDTXP_OP_SET_RATE, .rate = { .rate = 156250000 } },
+		{ .type = IDTXP_OP_WRITE_REG, .reg = IDTXP_REG_XO_1, .val = 1 },
+		{ .type = IDTXP_OP_WRITE_REG, .reg = IDTXP_REG_XO_2, .val = 2 },
+	};
+	struct clk_init_data init = {
+		.name = "idtxp-test",
+		.ops = &idtxp_clk_ops,
+		.flags = CLK_GET_RATE_NOCACHE,
+	};
+	struct idtxp_reader *reader;
+	struct idtxp_state state;
+	struct idtxp_event event;
+	unsigned int done;
+
+	KUNIT_ASSERT_EQ(test, idtxp_cdev_alloc(data), 0);
+	reader = kunit_kzalloc(test, sizeof(*reader), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, reader);
+	reader->cdev = data->cdev;
+	init_waitqueue_head(&reader->wait);
+	list_add_tail(&reader->node, &data->readers);
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	while (idtxp_pop_event(reader, &event) > 0)
+		;
+
+	/* The policies other than glide go through clk_set_rate() */
+	data->hw.init = &init;
+	KUNIT_ASSERT_EQ(test, clk_hw_register(&ctx->client->dev, &data->hw), 0);
+
+	/* 0.1% is too far for a small change, nothing is written */
+	idtxp_test_reset_counts(bus);
+	KUNIT_EXPECT_EQ(test, idtxp_change_rate(data, &req), -ERANGE);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 0);
+	KUNIT_EXPECT_EQ(test, data->req_freq, 100000000);
+
+	/* A large change may be forced for a close rate */
+	req.rate = 100010000;
+	req.policy = IDTXP_RATE_LARGE;
+	KUNIT_ASSERT_EQ(test, idtxp_change_rate(data, &req), 0);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_LARGE_FREQ_CHG_MASK);
+	KUNIT_ASSERT_TRUE(test, idtxp_pop_event(reader, &event));
+	KUNIT_EXPECT_EQ(test, event.type, IDTXP_EVENT_PLL_LOCKED);
+	KUNIT_ASSERT_TRUE(test, idtxp_pop_event(reader, &event));
+	KUNIT_EXPECT_EQ(test, event.type, IDTXP_EVENT_RATE_DONE);
+	KUNIT_EXPECT_EQ(test, event.err, 0);
+	KUNIT_EXPECT_EQ(test, event.rate, data->act_freq);
+	KUNIT_EXPECT_FALSE(test, idtxp_pop_event(reader, &event));
+
+	idtxp_get_state(data, &state);
+	KUNIT_EXPECT_EQ(test, state.req_freq, 100010000);
+	KUNIT_EXPECT_EQ(test, state.divo, data->divo);
+	KUNIT_EXPECT_EQ(test, state.divnfrac, data->divnfrac);
+	KUNIT_EXPECT_EQ(test, state.locked, 1);
+
+	/* and for the rate already set, which the clk core would skip */
+	idtxp_test_reset_counts(bus);
+	KUNIT_ASSERT_EQ(test, idtxp_change_rate(data, &req), 0);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_LARGE_FREQ_CHG_MASK);
+	KUNIT_EXPECT_EQ(test, bus->reg_writes, 3 + 2);
+
+	/*
+	 * or for a preset that generates another rate than listed, here
+	 * 1 Hz off with DIVO 4
+	 */
+	req.rate = 1800000000;
+	req.policy = IDTXP_RATE_AUTO;
+	KUNIT_ASSERT_EQ(test, idtxp_change_rate(data, &req), 0);
+	data->presets = kunit_kzalloc(test, sizeof(*data->presets), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, data->presets);
+	data->presets[0].rate = 1800000002;
+	data->num_presets = 1;
+	KUNIT_ASSERT_EQ(test, idtxp_solve_presets(data), 0);
+	KUNIT_ASSERT_EQ(test, data->presets[0].act_rate, 1800000001);
+	req.rate = 1800000002;
+	req.policy = IDTXP_RATE_LARGE;
+	idtxp_test_reset_counts(bus);
+	KUNIT_ASSERT_EQ(test, idtxp_change_rate(data, &req), 0);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_LARGE_FREQ_CHG_MASK);
+	KUNIT_EXPECT_EQ(test, data->req_freq, 1800000002);
+	while (idtxp_pop_event(reader, &event) > 0)
+		;
+
+	/* The ops run in order, the register writes as one script */
+	KUNIT_ASSERT_EQ(test, idtxp_run_batch(data, ops, 3, &done), 0);
+	KUNIT_EXPECT_EQ(test, done, 3);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 156250000);
+	KUNIT_EXPECT_EQ(test, bus->regs[IDTXP_REG_XO_2], 2);
+
+	/* A bad op anywhere rejects the whole batch */
+	ops[2].type = 0;
+	idtxp_test_reset_counts(bus);
+	KUNIT_EXPECT_EQ(test, idtxp_run_batch(data, ops, 3, &done), -EINVAL);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 0);
+
+	clk_hw_unregister(&data->hw);
+	idtxp_cdev_detach(data);
+}
+
+static void idtxp_test_cdev_remove(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	struct file filp = {
+		.private_data = &data->misc,
+		.f_flags = O_NONBLOCK,
+	};
+	struct idtxp_reader *reader;
+	struct idtxp_event event;
+
+	KUNIT_ASSERT_EQ(test, idtxp_cdev_alloc(data), 0);
+	KUNIT_ASSERT_EQ(test, idtxp_cdev_open(NULL, &filp), 0);
+	reader = filp.private_data;
+	KUNIT_EXPECT_EQ(test, idtxp_cdev_poll(&filp, NULL), 0);
+	idtxp_notify(data, IDTXP_EVENT_RATE_DONE, 0);
+	KUNIT_EXPECT_EQ(test, idtxp_cdev_poll(&filp, NULL),
+			EPOLLIN | EPOLLRDNORM);
+
+	/* The file stays open past remove, the device is gone for it */
+	idtxp_cdev_detach(data);
+	KUNIT_EXPECT_TRUE(test, list_empty(&data->readers));
+	memset(data, 0x6b, sizeof(*data));
+
+	KUNIT_EXPECT_EQ(test, idtxp_pop_event(reader, &event), -ENODEV);
+	KUNIT_EXPECT_EQ(test, idtxp_cdev_read(&filp, (char __user *)&event,
+					      sizeof(event), NULL), 0);
+	KUNIT_EXPECT_EQ(test, idtxp_cdev_poll(&filp, NULL),
+			EPOLLHUP | EPOLLERR);
+	KUNIT_EXPECT_EQ(test, idtxp_cdev_ioctl(&filp, IDTXP_IOC_GET_STATE, 0),
+			-ENODEV);
+	KUNIT_EXPECT_EQ(test, idtxp_cdev_release(NULL, &filp), 0);
+}
+
+static void idtxp_test_adjfine(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	u8 div_regs[NUM_FREQ_REGISTERS];
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	memcpy(div_regs, data->div_regs, NUM_FREQ_REGISTERS);
+	idtxp_test_reset_counts(bus);
+
+	/* +1 ppm moves the low fraction bytes only, without a relock */
+	KUNIT_ASSERT_EQ(test, idtxp_adjfine(data, 65536), 0);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 3);
+	KUNIT_EXPECT_LE(test, bus->reg_writes, 2 + 2);
+	KUNIT_EXPECT_EQ(test, bus->freq_chg, IDTXP_SMALL_FREQ_CHG_MASK);
+	KUNIT_EXPECT_EQ(test, bus->lock_polls, 0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000100);
+	KUNIT_EXPECT_EQ(test, memcmp(&bus->regs[IDTXP_REG_DIVO_7_0], div_regs,
+				     IDTXP_REG_DIVN_FRAC_7_0 -
+				     IDTXP_REG_DIVO_7_0), 0);
+
+	/* Trims are offsets from the rate set, they do not add up */
+	KUNIT_ASSERT_EQ(test, idtxp_adjfine(data, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000000);
+	KUNIT_EXPECT_EQ(test, memcmp(&bus->regs[IDTXP_REG_DIVO_7_0], div_regs,
+				     NUM_FREQ_REGISTERS), 0);
+	KUNIT_EXPECT_EQ(test, data->trims, 2);
+
+	KUNIT_EXPECT_EQ(test, idtxp_adjfine(data, 300 << 16), -ERANGE);
+}
+
+static void idtxp_test_adjfine_vco(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct idtxp_test_bus *bus = ctx->bus;
+	struct clk_idtxp *data = ctx->data;
+	u8 icp_value;
+
+	/* 68 * 100882353 Hz is just above the lowest VCO frequency */
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100882353, 0), 0);
+	KUNIT_ASSERT_EQ(test, data->divo, 68);
+	idtxp_test_reset_counts(bus);
+
+	KUNIT_EXPECT_EQ(test, idtxp_adjfine(data, -65536), -ERANGE);
+	KUNIT_EXPECT_EQ(test, bus->xfers, 0);
+	KUNIT_ASSERT_EQ(test, idtxp_adjfine(data, 65536), 0);
+	KUNIT_EXPECT_GE(test, data->fvco, FVCO_MIN);
+
+	/* 49 * 142855000 Hz is 105 kHz below the next charge pump band */
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 142855000, 0), 0);
+	KUNIT_ASSERT_EQ(test, data->divo, 49);
+	KUNIT_ASSERT_EQ(test, data->icp_value, 5);
+
+	KUNIT_ASSERT_EQ(test, idtxp_adjfine(data, 100 << 16), 0);
+	KUNIT_EXPECT_GE(test, data->fvco, 7000000000ULL);
+	KUNIT_EXPECT_EQ(test, data->icp_value, 4);
+	get_from_reg(bus->regs[IDTXP_REG_DIVO_7_0 + 2], &icp_value,
+		     IDTXP_ICP_VALUE_MASK);
+	KUNIT_EXPECT_EQ(test, icp_value, 4);
+}
+
+static void idtxp_test_prestage(struct kunit *test)
+{
+	struct idtxp_test_ctx *ctx = test->priv;
+	struct clk_idtxp *data = ctx->data;
+	struct clk_rate_request req = { .rate = 156250000 };
+	__u32 rate;
+
+	idtxp_test_setup_xtal(test, 50000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	data->rate_cache_hits = data->rate_cache_misses = 0;
+
+	/* Rounding a rate is only a query, it changes nothing */
+	KUNIT_ASSERT_EQ(test, idtxp_determine_rate(&data->hw, &req), 0);
+	KUNIT_EXPECT_EQ(test, req.rate, 156250000);
+	KUNIT_EXPECT_FALSE(test, data->prestage_valid);
+	KUNIT_EXPECT_EQ(test, data->rate_cache_hits + data->rate_cache_misses,
+			0);
+
+	/* A hinted rate is solved ahead, leaving the current one alone */
+	mutex_lock(&data->lock);
+	KUNIT_ASSERT_EQ(test, idtxp_prestage(data, req.rate), 0);
+	mutex_unlock(&data->lock);
+	KUNIT_EXPECT_TRUE(test, data->prestage_valid);
+	KUNIT_EXPECT_EQ(test, data->prestage.act_rate, 156250000);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 100000000);
+
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, req.rate, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->rate_cache_hits + data->rate_cache_misses,
+			0);
+	KUNIT_EXPECT_EQ(test, data->prestage_hits, 1);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 156250000);
+
+	/* Other rates still go through the rate cache */
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, 100000000, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->rate_cache_hits + data->rate_cache_misses,
+			1);
+	KUNIT_EXPECT_EQ(test, data->prestage.rate, 156250000);
+
+	/* Users hint the next rate through the device node */
+	rate = 125000000;
+	KUNIT_ASSERT_EQ(test, idtxp_cdev_do_ioctl(data, IDTXP_IOC_PRESTAGE,
+						  (unsigned long)&rate), 0);
+	KUNIT_EXPECT_EQ(test, data->prestage.act_rate, 125000000);
+	KUNIT_ASSERT_EQ(test, idtxp_set_rate(&data->hw, rate, 0), 0);
+	KUNIT_EXPECT_EQ(test, data->prestage_hits, 2);
+	KUNIT_EXPECT_EQ(test, data->act_freq, 125000000);
+
+	rate = data->max_freq + 1;
+	KUNIT_EXPECT_EQ(test, idtxp_cdev_do_ioctl(data, IDTXP_IOC_PRESTAGE,
+						  (unsigned long)&rate),
+			-EINVAL);
+}
+
+static struct kunit_case idtxp_test_cases[] = {
+	KUNIT_CASE(idtxp_test_solve_int),
+	KUNIT_CASE(idtxp_test_solve_frac),
+	KUNIT_CASE(idtxp_test_solve_range),
+	KUNIT_CASE(idtxp_test_int_rates),
+	KUNIT_CASE(idtxp_test_charge_pump),
+	KUNIT_CASE(idtxp_test_xo_settings),
+	KUNIT_CASE(idtxp_test_read_defaults),
+	KUNIT_CASE(idtxp_test_probe_xfers),
+	KUNIT_CASE(idtxp_test_set_rate_large),
+	KUNIT_CASE(idtxp_test_set_rate_small),
+	KUNIT_CASE(idtxp_test_set_rate_cached),
+	KUNIT_CASE(idtxp_test_latency_hist),
+	KUNIT_CASE(idtxp_test_pll_lock_wait),
+	KUNIT_CASE(idtxp_test_async_coalesce),
+	KUNIT_CASE(idtxp_test_glide),
+	KUNIT_CASE(idtxp_test_glide_runtime_pm),
+	KUNIT_CASE(idtxp_test_presets),
+	KUNIT_CASE(idtxp_test_nvm_commit),
+	KUNIT_CASE(idtxp_test_pm_restore),
+	KUNIT_CASE(idtxp_test_snapshot),
+	KUNIT_CASE(idtxp_test_script),
+	KUNIT_CASE(idtxp_test_cdev),
+	KUNIT_CASE(idtxp_test_cdev_remove),
+	KUNIT_CASE(idtxp_test_adjfine),
+	KUNIT_CASE(idtxp_test_adjfine_vco),
+	KUNIT_CASE(idtxp_test_prestage),
+	{ }
+};
+
+static struct kunit_suite idtxp_test_suite = {
+	.name = "clk-idtxp",
+	.init = idtxp_test_init,
+	.exit = idtxp_test_exit,
+	.test_cases = idtxp_test_cases,
+};
+kunit_test_suite(idtxp_test_suite);
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* clk_idtxp_trace.h - Trace events of the xp family driver.
+ *
+ * Copyright (C) 2018, Integrated Device Technology, Inc. <@idt.com>
+ *
+ * The events live in this directory rather than include/trace/events, so
+ * kbuild needs
+ *
+ *   CFLAGS_clk_idtxp.o := -I$(src)
+ *
+ * Enable them with
+ *
+ *   echo 1 > /sys/kernel/tracing/events/clk_idtxp/enable
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM clk_idtxp
+
+#if !defined(_CLK_IDTXP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _CLK_IDTXP_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+#include "clk_idtxp_core.h"
+
+TRACE_EVENT(idtxp_set_rate_start,
+
+	TP_PROTO(struct device *dev, unsigned long rate, u32 act_freq,
+		 bool small),
+
+	TP_ARGS(dev, rate, act_freq, small),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(unsigned long, rate)
+		__field(u32, act_freq)
+		__field(bool, small)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->rate = rate;
+		__entry->act_freq = act_freq;
+		__entry->small = small;
+	),
+
+	TP_printk("%s rate=%lu from=%u %s", __get_str(name), __entry->rate,
+		  __entry->act_freq, __entry->small ? "small" : "large")
+);
+
+TRACE_EVENT(idtxp_set_rate_done,
+
+	TP_PROTO(struct device *dev, unsigned long rate, u32 act_freq,
+		 s64 scaled_ppm, int err),
+
+	TP_ARGS(dev, rate, act_freq, scaled_ppm, err),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(unsigned long, rate)
+		__field(u32, act_freq)
+		__field(s64, scaled_ppm)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->rate = rate;
+		__entry->act_freq = act_freq;
+		__entry->scaled_ppm = scaled_ppm;
+		__entry->err = err;
+	),
+
+	TP_printk("%s rate=%lu act=%u scaled_ppm=%lld err=%d",
+		  __get_str(name), __entry->rate, __entry->act_freq,
+		  __entry->scaled_ppm, __entry->err)
+);
+
+TRACE_EVENT(idtxp_solve,
+
+	TP_PROTO(struct device *dev, u32 req_freq,
+		 const struct idtxp_divs *divs, u8 icp_value, bool cached),
+
+	TP_ARGS(dev, req_freq, divs, icp_value, cached),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(u32, req_freq)
+		__field(u16, divo)
+		__field(u16, divnint)
+		__field(u32, divnfrac)
+		__field(u64, fvco)
+		__field(s64, scaled_ppm)
+		__field(u8, icp_value)
+		__field(bool, cached)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->req_freq = req_freq;
+		__entry->divo = divs->divo;
+		__entry->divnint = divs->divnint;
+		__entry->divnfrac = divs->divnfrac;
+		__entry->fvco = divs->fvco;
+		__entry->scaled_ppm = divs->scaled_ppm;
+		__entry->icp_value = icp_value;
+		__entry->cached = cached;
+	),
+
+	TP_printk("%s req=%u divo=%u divnint=%u divnfrac=%u fvco=%llu "
+		  "scaled_ppm=%lld icp=%u%s", __get_str(name),
+		  __entry->req_freq, __entry->divo, __entry->divnint,
+		  __entry->divnfrac, __entry->fvco, __entry->scaled_ppm,
+		  __entry->icp_value, __entry->cached ? " cached" : "")
+);
+
+TRACE_EVENT(idtxp_commit,
+
+	TP_PROTO(struct device *dev, unsigned int reg, const u8 *val,
+		 unsigned int count),
+
+	TP_ARGS(dev, reg, val, count),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(unsigned int, reg)
+		__dynamic_array(u8, val, count)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->reg = reg;
+		memcpy(__get_dynamic_array(val), val, count);
+	),
+
+	TP_printk("%s [0x%02x] %s", __get_str(name), __entry->reg,
+		  __print_hex(__get_dynamic_array(val),
+			      __get_dynamic_array_len(val)))
+);
+
+TRACE_EVENT(idtxp_trigger,
+
+	TP_PROTO(struct device *dev, unsigned int reg, u8 val),
+
+	TP_ARGS(dev, reg, val),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(unsigned int, reg)
+		__field(u8, val)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->reg = reg;
+		__entry->val = val;
+	),
+
+	TP_printk("%s [0x%02x] = 0x%02x", __get_str(name), __entry->reg,
+		  __entry->val)
+);
+
+#endif /* _CLK_IDTXP_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE clk_idtxp_trace
+#include <trace/define_trace.h>